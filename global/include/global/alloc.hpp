@@ -0,0 +1,205 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <cstdlib>
+#include <memory_resource>
+#include <new>
+#include <utility>
+
+#ifdef __clang__
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wc++98-compat"
+#endif
+// Bump allocator, allocating is a pointer increment and everything is freed at once with reset(),
+// like once per frame. It grows with more blocks, which reset() merges into one, so the same work
+// every frame stops allocating after the first one. Destructors aren't called.
+// std::pmr containers can use it too: std::pmr::vector<int> numbers(&arena);
+class Arena final : public std::pmr::memory_resource {
+public:
+    explicit Arena(std::size_t block_size = 64 * 1024) : next_size(std::max<std::size_t>(block_size, 256)) {}
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+    ~Arena() override { release(); }
+
+    template <typename T, typename... Args>
+    T* create(Args&&... args) {
+        return new (allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+    }
+
+    // Value-initialized, so numbers are 0
+    template <typename T>
+    T* create_array(std::size_t count) {
+        T* array = static_cast<T*>(allocate(sizeof(T) * count, alignof(T)));
+        std::uninitialized_value_construct_n(array, count);
+        return array;
+    }
+
+    // Frees everything, keeping the memory for the next frame
+    void reset() {
+        if (blocks != nullptr && blocks->next != nullptr) {
+            std::size_t total = 0;
+            for (Block* block = blocks; block != nullptr; block = block->next) total += block->size;
+            release();
+            next_size = total;
+            grow(total - sizeof(Block));
+        }
+        if (blocks != nullptr) current = reinterpret_cast<char*>(blocks + 1);
+        retired = 0;
+    }
+
+    // Gives the memory back
+    void release() {
+        while (blocks != nullptr) {
+            Block* next = blocks->next;
+            ::operator delete(blocks);
+            blocks = next;
+        }
+        current = end = nullptr;
+        retired = 0;
+    }
+
+    // Bytes handed out since the last reset, and bytes allocated from the system
+    std::size_t used() const { return blocks == nullptr ? 0 : retired + static_cast<std::size_t>(current - reinterpret_cast<const char*>(blocks + 1)); }
+    std::size_t capacity() const {
+        std::size_t total = 0;
+        for (Block* block = blocks; block != nullptr; block = block->next) total += block->size;
+        return total;
+    }
+
+private:
+    struct alignas(std::max_align_t) Block {
+        Block* next;
+        std::size_t size;
+    };
+    Block* blocks = nullptr;    // The newest first
+    char* current = nullptr;
+    char* end = nullptr;
+    std::size_t next_size;
+    std::size_t retired = 0;    // Bytes used in the older blocks
+
+    void* do_allocate(std::size_t size, std::size_t alignment) override {
+        std::size_t padding = (0 - reinterpret_cast<std::uintptr_t>(current)) & (alignment - 1);
+        if (current == nullptr || padding + size > static_cast<std::size_t>(end - current)) {
+            grow(size + alignment);
+            padding = (0 - reinterpret_cast<std::uintptr_t>(current)) & (alignment - 1);
+        }
+        void* result = current + padding;
+        current += padding + size;
+        return result;
+    }
+    void do_deallocate(void*, std::size_t, std::size_t) override {}
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override { return this == &other; }
+
+    void grow(std::size_t size) {
+        if (blocks != nullptr) retired += static_cast<std::size_t>(current - reinterpret_cast<char*>(blocks + 1));
+        std::size_t block_size = std::max(next_size, size + sizeof(Block));
+        Block* block = static_cast<Block*>(::operator new(block_size));
+        block->next = blocks;
+        block->size = block_size;
+        blocks = block;
+        current = reinterpret_cast<char*>(block + 1);
+        end = reinterpret_cast<char*>(block) + block_size;
+        next_size = block_size * 2;
+    }
+};
+
+// Slots of one size with a free list, allocating and freeing take a few instructions and reuse memory.
+// Not thread-safe, and slots still in use when it's destroyed are freed without destructors.
+// As a memory resource it serves the nodes of std::pmr::list, map, set and unordered_map
+// up to the slot size, and passes anything else on to upstream.
+class FixedPool final : public std::pmr::memory_resource {
+public:
+    explicit FixedPool(std::size_t size, std::size_t alignment = alignof(std::max_align_t), std::size_t slots_per_block = 256,
+                       std::pmr::memory_resource* resource = std::pmr::get_default_resource())
+        : slot_alignment(std::max(alignment, alignof(void*))),
+          slot_size((std::max(size, sizeof(void*)) + slot_alignment - 1) / slot_alignment * slot_alignment),
+          header_size((sizeof(void*) + slot_alignment - 1) / slot_alignment * slot_alignment),
+          block_slots(std::max<std::size_t>(slots_per_block, 1)), upstream(resource) {}
+    FixedPool(const FixedPool&) = delete;
+    FixedPool& operator=(const FixedPool&) = delete;
+    ~FixedPool() override {
+        while (blocks != nullptr) {
+            void* next = *static_cast<void**>(blocks);
+            ::operator delete(blocks, std::align_val_t(slot_alignment));
+            blocks = next;
+        }
+    }
+
+    void* allocate_slot() {
+        if (free_list != nullptr) {
+            void* slot = free_list;
+            free_list = *static_cast<void**>(slot);
+            return slot;
+        }
+        if (next_new == block_end) grow();
+        void* slot = next_new;
+        next_new += slot_size;
+        return slot;
+    }
+
+    void deallocate_slot(void* slot) {
+        *static_cast<void**>(slot) = free_list;
+        free_list = slot;
+    }
+
+    std::size_t size() const { return slot_size; }
+
+private:
+    std::size_t slot_alignment;
+    std::size_t slot_size;
+    std::size_t header_size;    // The pointer to the next block, before the slots
+    std::size_t block_slots;
+    std::pmr::memory_resource* upstream;
+    void* blocks = nullptr;
+    void* free_list = nullptr;
+    char* next_new = nullptr;   // Slots in the newest block that haven't been used yet
+    char* block_end = nullptr;
+
+    void grow() {
+        void* block = ::operator new(header_size + slot_size * block_slots, std::align_val_t(slot_alignment));
+        *static_cast<void**>(block) = blocks;
+        blocks = block;
+        next_new = static_cast<char*>(block) + header_size;
+        block_end = next_new + slot_size * block_slots;
+    }
+
+    void* do_allocate(std::size_t size, std::size_t alignment) override {
+        if (size <= slot_size && alignment <= slot_alignment) return allocate_slot();
+        return upstream->allocate(size, alignment);
+    }
+    void do_deallocate(void* p, std::size_t size, std::size_t alignment) override {
+        if (size <= slot_size && alignment <= slot_alignment) deallocate_slot(p);
+        else upstream->deallocate(p, size, alignment);
+    }
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override { return this == &other; }
+};
+
+// Objects of one type from a FixedPool: Pool<Enemy> enemies; Enemy* enemy = enemies.create(x, y); enemies.destroy(enemy);
+template <typename T>
+class Pool {
+public:
+    explicit Pool(std::size_t slots_per_block = 256) : pool(sizeof(T), alignof(T), slots_per_block) {}
+
+    template <typename... Args>
+    T* create(Args&&... args) {
+        void* slot = pool.allocate_slot();
+        try {
+            return new (slot) T(std::forward<Args>(args)...);
+        }
+        catch (...) {
+            pool.deallocate_slot(slot);
+            throw;
+        }
+    }
+
+    void destroy(T* object) {
+        object->~T();
+        pool.deallocate_slot(object);
+    }
+
+private:
+    FixedPool pool;
+};
+#ifdef __clang__
+#pragma GCC diagnostic pop
+#endif // "-Wc++98-compat" (allocators: override, final, deleted functions)
@@ -0,0 +1,189 @@
+#pragma once
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include "platform.hpp"
+#include "print.hpp"
+#include "types.hpp"
+
+#ifdef __clang__
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wc++98-compat"
+#pragma GCC diagnostic ignored "-Wunused-template"
+#endif
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wunused-function"
+namespace global_detail {
+inline const volatile char* volatile bench_escape = nullptr;
+}
+
+// Makes the compiler think value is read, so the code computing it isn't removed
+template <typename T>
+static inline void do_not_optimize(const T& value) {
+    #ifdef _MSC_VER
+    global_detail::bench_escape = &reinterpret_cast<const volatile char&>(value);
+    _ReadWriteBarrier();
+    #else
+    asm volatile("" : : "r,m"(value) : "memory");
+    #endif
+}
+
+// Makes the compiler think all memory is read and written, so stores aren't removed
+static inline void clobber_memory() {
+    #ifdef _MSC_VER
+    _ReadWriteBarrier();
+    #else
+    asm volatile("" : : : "memory");
+    #endif
+}
+
+struct BenchResult {
+    std::string name;
+    double ns_per_op = 0.0;     // The median of the samples
+    double mean_ns = 0.0;
+    double stddev_ns = 0.0;
+    double min_ns = 0.0;
+    double max_ns = 0.0;
+    u64 iterations = 0;         // Calls per sample
+    int samples = 0;            // 0 if it was filtered out
+    double items_per_op = 1.0;
+    double items_per_second() const { return ns_per_op > 0.0 ? items_per_op * 1e9 / ns_per_op : 0.0; }
+};
+
+namespace global_detail {
+// From the environment, which "zmake bench" sets:
+// ZMAKE_BENCH_TIME (seconds per sample), ZMAKE_BENCH_SAMPLES, ZMAKE_BENCH_WARMUP (seconds),
+// ZMAKE_BENCH_FILTER (only names containing it) and ZMAKE_BENCH_JSON (a file to append the results to)
+struct BenchSettings {
+    double sample_ns = 2e7;
+    int samples = 10;
+    double warmup_ns = 1e8;
+    std::string filter;
+    std::string json;
+};
+
+inline const BenchSettings& bench_settings() {
+    static const BenchSettings settings = []() {
+        BenchSettings result;
+        const char* value = std::getenv("ZMAKE_BENCH_TIME");
+        if (value != nullptr && std::atof(value) > 0.0) result.sample_ns = std::atof(value) * 1e9;
+        value = std::getenv("ZMAKE_BENCH_SAMPLES");
+        if (value != nullptr && std::atoi(value) > 0) result.samples = std::atoi(value);
+        value = std::getenv("ZMAKE_BENCH_WARMUP");
+        if (value != nullptr && std::atof(value) >= 0.0) result.warmup_ns = std::atof(value) * 1e9;
+        value = std::getenv("ZMAKE_BENCH_FILTER");
+        if (value != nullptr) result.filter = value;
+        value = std::getenv("ZMAKE_BENCH_JSON");
+        if (value != nullptr) result.json = value;
+        return result;
+    }();
+    return settings;
+}
+
+inline std::string bench_json(const BenchResult& result) {
+    std::string name;
+    for (char c : result.name) {
+        if (c == '"' || c == '\\') name += '\\';
+        if (static_cast<unsigned char>(c) >= 0x20) name += c;
+    }
+    char line[512];
+    std::snprintf(line, sizeof(line), "{\"name\": \"%s\", \"ns_per_op\": %.6g, \"mean_ns\": %.6g, \"stddev_ns\": %.6g, "
+                  "\"min_ns\": %.6g, \"max_ns\": %.6g, \"iterations\": %llu, \"samples\": %d, \"items_per_op\": %.6g}\n",
+                  name.substr(0, 200).c_str(), result.ns_per_op, result.mean_ns, result.stddev_ns, result.min_ns, result.max_ns,
+                  result.iterations, result.samples, result.items_per_op);
+    return line;
+}
+
+// "- name   12.3 ns/op  +-0.4%  81.2 M/s", items per second when there's more than one per call
+inline void bench_report(const BenchResult& result) {
+    const BenchSettings& settings = bench_settings();
+    if (!settings.json.empty()) {
+        FILE* file = std::fopen(settings.json.c_str(), "a");
+        if (file == nullptr) return;
+        std::string line = bench_json(result);
+        std::fwrite(line.data(), 1, line.size(), file);
+        std::fclose(file);
+        return;
+    }
+    double rate = result.items_per_second();
+    const char* unit = rate >= 1e9 ? "G" : rate >= 1e6 ? "M" : rate >= 1e3 ? "k" : "";
+    double scale = rate >= 1e9 ? 1e9 : rate >= 1e6 ? 1e6 : rate >= 1e3 ? 1e3 : 1.0;
+    std::fprintf(stderr, "- %-32s %12.2f ns/op  +-%5.1f%%  %8.2f %s%s/s\n", result.name.c_str(), result.ns_per_op,
+                 result.ns_per_op > 0.0 ? result.stddev_ns / result.ns_per_op * 100.0 : 0.0, rate / scale, unit,
+                 result.items_per_op == 1.0 ? "op" : "items");
+}
+}
+
+// Times function() and reports it to stderr: it's called in batches, with the batch size calibrated
+// so one takes about 20 ms, first for 0.1 s of warmup and then for 10 samples. The results are the
+// nanoseconds per call, items_per_op is how many things one call processes, for the throughput.
+// Use do_not_optimize() on results and clobber_memory() after stores, so the work isn't removed.
+template <typename F>
+static BenchResult bench(const std::string& name, double items_per_op, F&& function) {
+    const global_detail::BenchSettings& settings = global_detail::bench_settings();
+    BenchResult result;
+    result.name = name;
+    result.items_per_op = items_per_op;
+    if (!settings.filter.empty() && name.find(settings.filter) == std::string::npos) return result;
+
+    print_flush();
+    auto run = [&](u64 calls) {
+        auto start = std::chrono::steady_clock::now();
+        for (u64 i = 0; i < calls; i++) function();
+        return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+    };
+
+    // Grow the batch until it takes a sample's time, and keep going for the warmup.
+    // If the compiler removed the work nothing takes time, so stop growing somewhere
+    const u64 max_calls = 1ULL << 40;
+    u64 calls = 1;
+    double total = 0.0;
+    for (;;) {
+        double elapsed = run(calls);
+        total += elapsed;
+        if (calls >= max_calls) break;
+        if (elapsed >= settings.sample_ns * 0.9) {
+            if (total >= settings.warmup_ns) break;
+            continue;
+        }
+        double factor = elapsed > 0.0 ? settings.sample_ns / elapsed : 100.0;
+        calls = std::min(max_calls, static_cast<u64>(static_cast<double>(calls) * std::min(std::max(factor * 1.1, 1.5), 100.0)) + 1);
+    }
+
+    std::vector<double> samples;
+    for (int i = 0; i < settings.samples; i++) samples.push_back(run(calls) / static_cast<double>(calls));
+    std::sort(samples.begin(), samples.end());
+    std::size_t middle = samples.size() / 2;
+    result.ns_per_op = samples.size() % 2 == 1 ? samples[middle] : (samples[middle - 1] + samples[middle]) / 2.0;
+    for (double sample : samples) result.mean_ns += sample;
+    result.mean_ns /= static_cast<double>(samples.size());
+    for (double sample : samples) result.stddev_ns += (sample - result.mean_ns) * (sample - result.mean_ns);
+    if (samples.size() > 1) result.stddev_ns = std::sqrt(result.stddev_ns / static_cast<double>(samples.size() - 1));
+    result.min_ns = samples.front();
+    result.max_ns = samples.back();
+    result.iterations = calls;
+    result.samples = settings.samples;
+    global_detail::bench_report(result);
+    return result;
+}
+
+template <typename F>
+static BenchResult bench(const std::string& name, F&& function) {
+    return bench(name, 1.0, std::forward<F>(function));
+}
+
+// "- new is 4.2x as fast as old"
+static void bench_compare(const BenchResult& baseline, const BenchResult& result) {
+    if (baseline.samples == 0 || result.samples == 0 || !global_detail::bench_settings().json.empty()) return;
+    std::fprintf(stderr, "- %s is %.2fx as fast as %s\n", result.name.c_str(),
+                 baseline.ns_per_op / baseline.items_per_op / (result.ns_per_op / result.items_per_op), baseline.name.c_str());
+}
+#pragma GCC diagnostic pop
+#ifdef __clang__
+#pragma GCC diagnostic pop
+#endif // "-Wc++98-compat" (bench: lambdas, auto)
@@ -0,0 +1,268 @@
+#pragma once
+#include <cerrno>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <utility>
+#include "print.hpp"
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef __clang__
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wc++98-compat"
+#pragma GCC diagnostic ignored "-Wunused-template"
+#endif
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wunused-function"
+// A whole file as read-only memory, mapped instead of copied, so reading it is just touching pages.
+// The view stays valid until the file is closed or destroyed: MappedFile file("data.txt"); file.view()
+// Windows, pipes and other files that can't be mapped are read into memory instead.
+class MappedFile {
+public:
+    MappedFile() = default;
+    explicit MappedFile(const std::string& path) { open(path); }
+    MappedFile(MappedFile&& other) noexcept { swap(other); }
+    MappedFile& operator=(MappedFile&& other) noexcept {
+        if (this != &other) {
+            close();
+            swap(other);
+        }
+        return *this;
+    }
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    ~MappedFile() { close(); }
+
+    // False if the file can't be opened, an empty file opens with an empty view
+    bool open(const std::string& path) {
+        close();
+        #ifndef _WIN32
+        int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) return false;
+        struct stat info;
+        if (fstat(fd, &info) != 0) {
+            ::close(fd);
+            return false;
+        }
+        if (S_ISREG(info.st_mode) && info.st_size > 0) {
+            std::size_t length = static_cast<std::size_t>(info.st_size);
+            void* address = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (address != MAP_FAILED) {
+                ::close(fd);
+                madvise(address, length, MADV_SEQUENTIAL);
+                mapping = address;
+                bytes = static_cast<const char*>(address);
+                count = length;
+                opened = true;
+                return true;
+            }
+        }
+        // Read from the fd that's open, opening a pipe or /dev/stdin again could give another stream
+        char chunk[64 * 1024];
+        for (;;) {
+            ssize_t length = ::read(fd, chunk, sizeof(chunk));
+            if (length > 0) owned.append(chunk, static_cast<std::size_t>(length));
+            else if (length == 0) break;
+            else if (errno != EINTR) {
+                ::close(fd);
+                owned = std::string();
+                return false;
+            }
+        }
+        ::close(fd);
+        #else
+        FILE* file = std::fopen(path.c_str(), "rb");
+        if (file == nullptr) return false;
+        char chunk[64 * 1024];
+        std::size_t length;
+        while ((length = std::fread(chunk, 1, sizeof(chunk), file)) > 0) owned.append(chunk, length);
+        std::fclose(file);
+        #endif
+        bytes = owned.data();
+        count = owned.size();
+        opened = true;
+        return true;
+    }
+
+    void close() {
+        #ifndef _WIN32
+        if (mapping != nullptr) munmap(mapping, count);
+        #endif
+        mapping = nullptr;
+        owned = std::string();
+        bytes = nullptr;
+        count = 0;
+        opened = false;
+    }
+
+    bool is_open() const { return opened; }
+    const char* data() const { return bytes; }
+    std::size_t size() const { return count; }
+    std::string_view view() const { return std::string_view(bytes, count); }
+
+private:
+    void* mapping = nullptr;
+    std::string owned;
+    const char* bytes = nullptr;
+    std::size_t count = 0;
+    bool opened = false;
+
+    void swap(MappedFile& other) noexcept {
+        std::swap(mapping, other.mapping);
+        std::swap(owned, other.owned);
+        std::swap(bytes, other.bytes);
+        std::swap(count, other.count);
+        std::swap(opened, other.opened);
+        // A short string's data is inside the object, so it moved with it
+        if (mapping == nullptr && opened) bytes = owned.data();
+        if (other.mapping == nullptr && other.opened) other.bytes = other.owned.data();
+    }
+};
+
+// Lines of text without "\n" or "\r\n", there's no empty last line after a final newline.
+// The lines point into text: for (std::string_view line : split_lines(file.view()))
+class LineIterator {
+public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = std::string_view;
+    using difference_type = std::ptrdiff_t;
+    using pointer = const std::string_view*;
+    using reference = const std::string_view&;
+
+    LineIterator() = default;
+    LineIterator(const char* begin, const char* end) : next(begin), last(end) { advance(); }
+
+    reference operator*() const { return line; }
+    pointer operator->() const { return &line; }
+    LineIterator& operator++() {
+        advance();
+        return *this;
+    }
+    LineIterator operator++(int) {
+        LineIterator copy = *this;
+        advance();
+        return copy;
+    }
+    bool operator==(const LineIterator& other) const { return next == other.next; }
+    bool operator!=(const LineIterator& other) const { return next != other.next; }
+
+private:
+    const char* next = nullptr;   // nullptr when there are no more lines
+    const char* last = nullptr;
+    std::string_view line;
+
+    void advance() {
+        if (next == last) {
+            next = nullptr;
+            return;
+        }
+        const char* newline = static_cast<const char*>(std::memchr(next, '\n', static_cast<std::size_t>(last - next)));
+        const char* line_end = newline != nullptr ? newline : last;
+        std::size_t length = static_cast<std::size_t>(line_end - next);
+        if (length > 0 && line_end[-1] == '\r') length--;
+        line = std::string_view(next, length);
+        next = newline != nullptr ? newline + 1 : last;
+    }
+};
+
+struct LineRange {
+    const char* first;
+    const char* last;
+    LineIterator begin() const { return LineIterator(first, last); }
+    LineIterator end() const { return LineIterator(); }
+};
+
+static inline LineRange split_lines(std::string_view text) {
+    return LineRange{ text.data(), text.data() + text.size() };
+}
+
+// Writes a file through its own large buffer instead of std::ofstream's, with print()/printl() formatting.
+// Nothing is written until the buffer fills up or it's flushed or closed, close() tells if all of it made it.
+class FileWriter {
+public:
+    static constexpr std::size_t BUFFER_SIZE = 1024 * 1024;
+
+    FileWriter() = default;
+    explicit FileWriter(const std::string& path, bool append = false) { open(path, append); }
+    FileWriter(const FileWriter&) = delete;
+    FileWriter& operator=(const FileWriter&) = delete;
+    ~FileWriter() { close(); }
+
+    bool open(const std::string& path, bool append = false) {
+        close();
+        file = std::fopen(path.c_str(), append ? "ab" : "wb");
+        if (file == nullptr) return false;
+        std::setvbuf(file, nullptr, _IONBF, 0);
+        if (buffer == nullptr) buffer = std::make_unique<char[]>(BUFFER_SIZE);
+        failed = false;
+        return true;
+    }
+
+    bool good() const { return file != nullptr && !failed; }
+
+    void write(const char* data, std::size_t size) {
+        if (file == nullptr) return;
+        if (used + size > BUFFER_SIZE) {
+            flush();
+            if (size > BUFFER_SIZE) {
+                if (std::fwrite(data, 1, size, file) != size) failed = true;
+                return;
+            }
+        }
+        std::memcpy(buffer.get() + used, data, size);
+        used += size;
+    }
+    void write(std::string_view text) { write(text.data(), text.size()); }
+
+    template <typename... Args>
+    void print(Args&&... args) {
+        (format_value(args), ...);
+    }
+
+    template <typename Arg, typename... Args>
+    void printl(Arg&& arg, Args&&... args) {
+        format_value(arg);
+        ((write(" ", 1), format_value(args)), ...);
+        write("\n", 1);
+    }
+
+    bool flush() {
+        if (file == nullptr) return false;
+        if (used > 0 && std::fwrite(buffer.get(), 1, used, file) != used) failed = true;
+        used = 0;
+        return !failed;
+    }
+
+    bool close() {
+        if (file == nullptr) return false;
+        flush();
+        if (std::fclose(file) != 0) failed = true;
+        file = nullptr;
+        return !failed;
+    }
+
+private:
+    FILE* file = nullptr;
+    std::unique_ptr<char[]> buffer;
+    std::size_t used = 0;
+    bool failed = false;
+
+    template <typename T>
+    void format_value(const T& value) {
+        global_detail::format_value([this](const char* data, std::size_t size) { write(data, size); }, value);
+    }
+};
+#pragma GCC diagnostic pop
+#ifdef __clang__
+#pragma GCC diagnostic pop
+#endif // "-Wc++98-compat" (file io: nullptr, lambdas)
@@ -0,0 +1,314 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstring>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#ifdef __clang__
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wc++98-compat"
+#pragma GCC diagnostic ignored "-Wunused-template"
+#endif
+namespace global_detail {
+// Counts the tasks of a parallel_for or TaskGroup that haven't finished, and keeps the first exception
+struct Join {
+    std::atomic<std::size_t> pending{ 0 };
+    std::atomic<bool> failed{ false };
+    std::exception_ptr error;
+};
+
+// A function and what it captured, in 64 bytes. Small trivially copyable functions (like lambdas that
+// capture references, pointers and numbers) are stored in it, larger ones are allocated
+struct Task {
+    void (*run)(Task&);
+    Join* join;
+    alignas(std::max_align_t) unsigned char data[48];
+};
+
+template <typename F>
+inline Task make_task(F&& function, Join* join) {
+    using Function = std::decay_t<F>;
+    Task task;
+    task.join = join;
+    if constexpr (sizeof(Function) <= sizeof(task.data) && alignof(Function) <= alignof(std::max_align_t) &&
+                  std::is_trivially_copyable_v<Function> && std::is_trivially_destructible_v<Function>) {
+        new (task.data) Function(std::forward<F>(function));
+        task.run = [](Task& self) { (*std::launder(reinterpret_cast<Function*>(self.data)))(); };
+    }
+    else {
+        Function* pointer = new Function(std::forward<F>(function));
+        std::memcpy(task.data, &pointer, sizeof(pointer));
+        task.run = [](Task& self) {
+            Function* owned;
+            std::memcpy(&owned, self.data, sizeof(owned));
+            std::unique_ptr<Function> owner(owned);
+            (*owned)();
+        };
+    }
+    return task;
+}
+
+inline void execute(Task& task) {
+    Join* join = task.join;
+    try {
+        task.run(task);
+    }
+    catch (...) {
+        if (!join->failed.exchange(true)) join->error = std::current_exception();
+    }
+    join->pending.fetch_sub(1, std::memory_order_acq_rel);
+}
+
+// The tasks of one thread, which it pushes and pops at the back while other threads steal from the front.
+// The lock is only contended while stealing, and the tasks are stored in place
+struct alignas(64) WorkQueue {
+    static constexpr std::size_t CAPACITY = 1024;
+    std::atomic_flag lock = ATOMIC_FLAG_INIT;
+    std::atomic<std::size_t> head{ 0 };
+    std::atomic<std::size_t> tail{ 0 };
+    Task* tasks = nullptr;
+
+    void acquire() { while (lock.test_and_set(std::memory_order_acquire)) std::this_thread::yield(); }
+    void release() { lock.clear(std::memory_order_release); }
+    bool empty() const { return head.load(std::memory_order_relaxed) == tail.load(std::memory_order_relaxed); }
+
+    bool push(const Task& task) {
+        acquire();
+        std::size_t back = tail.load(std::memory_order_relaxed);
+        bool full = back - head.load(std::memory_order_relaxed) == CAPACITY;
+        if (!full) {
+            tasks[back % CAPACITY] = task;
+            tail.store(back + 1, std::memory_order_relaxed);
+        }
+        release();
+        return !full;
+    }
+
+    bool pop(Task& task, bool back) {
+        if (empty()) return false;
+        acquire();
+        std::size_t first = head.load(std::memory_order_relaxed), last = tail.load(std::memory_order_relaxed);
+        bool found = first != last;
+        if (found && back) {
+            task = tasks[(last - 1) % CAPACITY];
+            tail.store(last - 1, std::memory_order_relaxed);
+        }
+        else if (found) {
+            task = tasks[first % CAPACITY];
+            head.store(first + 1, std::memory_order_relaxed);
+        }
+        release();
+        return found;
+    }
+};
+
+// The pool the thread works for, and its queue
+inline thread_local const void* current_pool = nullptr;
+inline thread_local std::size_t current_queue = 0;
+}
+
+// Work-stealing thread pool. Every thread has its own queue of tasks and takes work from the others
+// when it runs out, and a thread waiting for tasks to finish runs tasks meanwhile, so it can be nested.
+// Queued tasks are stored in place, so parallel_for and small task group functions don't allocate.
+class ThreadPool {
+public:
+    // threads counts the thread that waits for the work, so it starts one less
+    explicit ThreadPool(unsigned threads = std::thread::hardware_concurrency())
+        : queues(std::max(threads, 1U)), storage(queues.size() * global_detail::WorkQueue::CAPACITY) {
+        for (std::size_t i = 0; i < queues.size(); i++) queues[i].tasks = storage.data() + i * global_detail::WorkQueue::CAPACITY;
+        for (std::size_t i = 1; i < queues.size(); i++) workers.emplace_back([this, i]() { work(i); });
+    }
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+    ~ThreadPool() {
+        {
+            std::lock_guard<std::mutex> lock(sleep_mutex);
+            stopping = true;
+        }
+        sleep_condition.notify_all();
+        for (std::thread& worker : workers) worker.join();
+    }
+
+    unsigned size() const { return static_cast<unsigned>(queues.size()); }
+
+    // function(i) for every i in [begin, end), split in ranges of at least grain (default about 8 per thread)
+    template <typename F>
+    void parallel_for(std::size_t begin, std::size_t end, F&& function, std::size_t grain = 0) {
+        if (begin >= end) return;
+        if (grain == 0) grain = std::max<std::size_t>(1, (end - begin) / (queues.size() * 8));
+        global_detail::Join join;
+        ForRange<std::remove_reference_t<F>> range{ this, &join, &function, grain };
+        try {
+            split(range, begin, end);
+        }
+        catch (...) {
+            if (!join.failed.exchange(true)) join.error = std::current_exception();
+        }
+        finish(join);
+    }
+
+    // reduce(... reduce(reduce(identity, map(begin)), map(begin + 1)) ..., map(end - 1)), in ranges of grain
+    // combined in order, so it's the same every time with the same grain and number of threads
+    template <typename T, typename Map, typename Reduce>
+    T parallel_reduce(std::size_t begin, std::size_t end, T identity, Map&& map, Reduce&& reduce, std::size_t grain = 0) {
+        if (begin >= end) return identity;
+        if (grain == 0) grain = std::max<std::size_t>(1, (end - begin) / (queues.size() * 8));
+        std::vector<T> partial((end - begin + grain - 1) / grain, identity);
+        parallel_for(0, partial.size(), [&](std::size_t chunk) {
+            std::size_t first = begin + chunk * grain, last = std::min(end, first + grain);
+            T value = identity;
+            for (std::size_t i = first; i < last; i++) value = reduce(std::move(value), map(i));
+            partial[chunk] = std::move(value);
+        }, 1);
+        T result = std::move(identity);
+        for (T& value : partial) result = reduce(std::move(result), std::move(value));
+        return result;
+    }
+
+    // Used by TaskGroup: queues the task on the calling thread's queue, or runs it if that's full
+    void submit(global_detail::Task task) {
+        task.join->pending.fetch_add(1, std::memory_order_relaxed);
+        std::size_t queue = global_detail::current_pool == this ? global_detail::current_queue : 0;
+        queued.fetch_add(1);
+        if (!queues[queue].push(task)) {
+            queued.fetch_sub(1);
+            global_detail::execute(task);
+            return;
+        }
+        if (sleeping.load() > 0) {
+            std::lock_guard<std::mutex> lock(sleep_mutex);
+            sleep_condition.notify_one();
+        }
+    }
+
+    // Runs tasks until the ones in join are done, then throws the first exception they threw
+    void finish(global_detail::Join& join) {
+        std::size_t queue = global_detail::current_pool == this ? global_detail::current_queue : 0;
+        for (int idle = 0; join.pending.load(std::memory_order_acquire) != 0;) {
+            global_detail::Task task;
+            if (take(queue, task)) {
+                global_detail::execute(task);
+                idle = 0;
+            }
+            else if (++idle > 64) std::this_thread::yield();
+        }
+        if (join.failed.load()) {
+            std::exception_ptr error = join.error;
+            join.error = nullptr;
+            join.failed = false;
+            std::rethrow_exception(error);
+        }
+    }
+
+private:
+    template <typename F>
+    struct ForRange {
+        ThreadPool* pool;
+        global_detail::Join* join;
+        F* function;
+        std::size_t grain;
+    };
+
+    // Queues the upper half until the range is small enough, so idle threads steal big ranges first
+    template <typename Range>
+    static void split(Range& range, std::size_t begin, std::size_t end) {
+        while (end - begin > range.grain) {
+            std::size_t middle = begin + (end - begin) / 2;
+            Range* shared = &range;
+            range.pool->submit(global_detail::make_task([shared, middle, end]() { split(*shared, middle, end); }, range.join));
+            end = middle;
+        }
+        for (std::size_t i = begin; i < end; i++) (*range.function)(i);
+    }
+
+    // Its own newest task, or the oldest one of another thread
+    bool take(std::size_t queue, global_detail::Task& task) {
+        bool found = queues[queue].pop(task, true);
+        for (std::size_t i = 1; !found && i < queues.size(); i++) found = queues[(queue + i) % queues.size()].pop(task, false);
+        if (found) queued.fetch_sub(1);
+        return found;
+    }
+
+    void work(std::size_t queue) {
+        global_detail::current_pool = this;
+        global_detail::current_queue = queue;
+        for (int idle = 0;;) {
+            global_detail::Task task;
+            if (take(queue, task)) {
+                global_detail::execute(task);
+                idle = 0;
+                continue;
+            }
+            if (++idle < 256) {
+                std::this_thread::yield();
+                continue;
+            }
+            std::unique_lock<std::mutex> lock(sleep_mutex);
+            sleeping.fetch_add(1);
+            sleep_condition.wait(lock, [this]() { return queued.load() > 0 || stopping; });
+            sleeping.fetch_sub(1);
+            if (stopping) return;
+            idle = 0;
+        }
+    }
+
+    std::vector<global_detail::WorkQueue> queues;   // 0 is for threads outside the pool
+    std::vector<global_detail::Task> storage;
+    std::vector<std::thread> workers;
+    std::atomic<std::size_t> queued{ 0 };
+    std::atomic<int> sleeping{ 0 };
+    std::mutex sleep_mutex;
+    std::condition_variable sleep_condition;
+    bool stopping = false;
+};
+
+// The pool parallel_for, parallel_reduce and TaskGroup use by default, started by the first call
+// with threads (0 is one per core). It's inline, so every file of the program shares it
+inline ThreadPool& thread_pool(unsigned threads = 0) {
+    static ThreadPool pool(threads != 0 ? threads : std::thread::hardware_concurrency());
+    return pool;
+}
+
+// Runs functions in parallel until wait(), which also happens when it goes out of scope
+class TaskGroup {
+public:
+    explicit TaskGroup(ThreadPool& target = thread_pool()) : pool(target) {}
+    TaskGroup(const TaskGroup&) = delete;
+    TaskGroup& operator=(const TaskGroup&) = delete;
+    ~TaskGroup() {
+        try { wait(); }
+        catch (...) {}
+    }
+
+    template <typename F>
+    void run(F&& function) { pool.submit(global_detail::make_task(std::forward<F>(function), &join)); }
+
+    // Throws the first exception a function threw
+    void wait() { pool.finish(join); }
+
+private:
+    ThreadPool& pool;
+    global_detail::Join join;
+};
+
+template <typename F>
+static void parallel_for(std::size_t begin, std::size_t end, F&& function, std::size_t grain = 0) {
+    thread_pool().parallel_for(begin, end, std::forward<F>(function), grain);
+}
+
+template <typename T, typename Map, typename Reduce>
+static T parallel_reduce(std::size_t begin, std::size_t end, T identity, Map&& map, Reduce&& reduce, std::size_t grain = 0) {
+    return thread_pool().parallel_reduce(begin, end, std::move(identity), std::forward<Map>(map), std::forward<Reduce>(reduce), grain);
+}
+#ifdef __clang__
+#pragma GCC diagnostic pop
+#endif // "-Wc++98-compat" (thread pool: atomics, lambdas)
@@ -0,0 +1,43 @@
+#pragma once
+// The intrinsics strings.hpp and simd.hpp use, and the SIMD backend they pick
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wunused-macros"
+// The backend of SimdFloat and SimdInt, define GLOBAL_SIMD as one of these to pick another
+#define GLOBAL_SIMD_SCALAR 1
+#define GLOBAL_SIMD_SSE 2
+#define GLOBAL_SIMD_AVX2 3
+#define GLOBAL_SIMD_AVX512 4
+#define GLOBAL_SIMD_NEON 5
+#pragma GCC diagnostic pop
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#pragma GCC diagnostic push
+#ifndef __clang__
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"   // GCC's _mm512_undefined_ps() and others, when inlined
+#endif
+#if defined(__AVX__) || defined(_MSC_VER)
+#include <immintrin.h>
+#else
+#include <emmintrin.h>   // All strings.hpp uses without AVX, and a fraction of the compile time
+#endif
+#pragma GCC diagnostic pop
+#ifndef GLOBAL_SIMD
+#if defined(__AVX512F__)
+#define GLOBAL_SIMD GLOBAL_SIMD_AVX512
+#elif defined(__AVX2__)
+#define GLOBAL_SIMD GLOBAL_SIMD_AVX2
+#else
+#define GLOBAL_SIMD GLOBAL_SIMD_SSE
+#endif
+#endif
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#ifndef GLOBAL_SIMD
+#define GLOBAL_SIMD GLOBAL_SIMD_NEON
+#endif
+#endif
+#ifndef GLOBAL_SIMD
+#define GLOBAL_SIMD GLOBAL_SIMD_SCALAR
+#endif
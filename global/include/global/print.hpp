@@ -0,0 +1,176 @@
+#pragma once
+#include <charconv>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wunused-function"
+#ifdef __clang__
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wc++98-compat"
+#pragma GCC diagnostic ignored "-Wunused-template"
+#endif
+// print() and printl() write to a buffer per thread, which goes to stdout in one write when it's full,
+// on print_flush(), when the thread exits and at exit. To a terminal every call is written right away.
+// Lines from different threads don't mix, unless they're longer than the buffer.
+// print_sync() writes right away, in one piece.
+// Numbers are formatted with to_chars, like std::cout would (floats with 6 significant digits).
+// Flush before writing to std::cout or printf yourself, or the order gets mixed up.
+// The buffers are inline variables, so every file of the program shares them.
+namespace global_detail {
+struct PrintBuffer {
+    char data[8192];
+    std::size_t size;
+    int mode;   // 0 until the first print, then PRINT_BUFFERED or PRINT_DIRECT
+};
+enum { PRINT_BUFFERED = 1, PRINT_DIRECT = 2 };
+inline thread_local PrintBuffer print_buffer;   // Trivially destructible, so it works during exit too
+inline std::mutex print_mutex;
+
+inline void print_write(const char* data, std::size_t size) {
+    std::lock_guard<std::mutex> lock(print_mutex);
+    std::fwrite(data, 1, size, stdout);
+    std::fflush(stdout);
+}
+
+inline void print_flush(PrintBuffer& buffer) {
+    if (buffer.size == 0) return;
+    print_write(buffer.data, buffer.size);
+    buffer.size = 0;
+}
+
+struct PrintFlusher {
+    ~PrintFlusher() {
+        print_flush(print_buffer);
+        print_buffer.mode = PRINT_DIRECT;   // Static destructors can still print
+    }
+};
+
+inline PrintBuffer& get_print_buffer() {
+    PrintBuffer& buffer = print_buffer;
+    if (buffer.mode == 0) {
+        thread_local PrintFlusher flusher;
+        (void)flusher;
+        #ifdef _WIN32
+        buffer.mode = _isatty(_fileno(stdout)) ? PRINT_DIRECT : PRINT_BUFFERED;
+        #else
+        buffer.mode = isatty(fileno(stdout)) ? PRINT_DIRECT : PRINT_BUFFERED;
+        #endif
+    }
+    return buffer;
+}
+
+inline void print_append(PrintBuffer& buffer, const char* data, std::size_t size) {
+    if (size > sizeof(buffer.data) - buffer.size) {
+        // Only complete lines are written, so lines from different threads don't mix
+        std::size_t lines = buffer.size;
+        while (lines > 0 && buffer.data[lines - 1] != '\n') lines--;
+        if (lines > 0) {
+            print_write(buffer.data, lines);
+            std::memmove(buffer.data, buffer.data + lines, buffer.size - lines);
+            buffer.size -= lines;
+        }
+        if (size > sizeof(buffer.data) - buffer.size) {
+            // Longer than the buffer, written together with the start of the line
+            std::lock_guard<std::mutex> lock(print_mutex);
+            std::fwrite(buffer.data, 1, buffer.size, stdout);
+            std::fwrite(data, 1, size, stdout);
+            std::fflush(stdout);
+            buffer.size = 0;
+            return;
+        }
+    }
+    std::memcpy(buffer.data + buffer.size, data, size);
+    buffer.size += size;
+}
+
+// Formats value like std::cout would and passes it to append(data, size)
+template <typename Append, typename T>
+inline void format_value(Append&& append, const T& value) {
+    using U = std::decay_t<T>;
+    if constexpr (std::is_same_v<U, bool>) {
+        append(value ? "1" : "0", 1);
+    }
+    else if constexpr (std::is_same_v<U, char> || std::is_same_v<U, signed char> || std::is_same_v<U, unsigned char>) {
+        char c = static_cast<char>(value);
+        append(&c, 1);
+    }
+    else if constexpr (std::is_integral_v<U>) {
+        char str[48];
+        std::to_chars_result result = std::to_chars(str, str + sizeof(str), value);
+        append(str, static_cast<std::size_t>(result.ptr - str));
+    }
+    else if constexpr (std::is_floating_point_v<U>) {
+        char str[128];
+        #if defined(__cpp_lib_to_chars) || defined(_MSC_VER)
+        std::to_chars_result result = std::to_chars(str, str + sizeof(str), value, std::chars_format::general, 6);
+        append(str, static_cast<std::size_t>(result.ptr - str));
+        #else
+        int length = std::snprintf(str, sizeof(str), "%g", static_cast<double>(value));
+        append(str, static_cast<std::size_t>(length));
+        #endif
+    }
+    else if constexpr (std::is_convertible_v<const U&, std::string_view>) {
+        std::string_view str = value;
+        append(str.data(), str.size());
+    }
+    else {
+        // Anything else with an operator<<
+        thread_local std::ostringstream oss;
+        oss.str("");
+        oss.clear();
+        oss << value;
+        std::string str = oss.str();
+        append(str.data(), str.size());
+    }
+}
+
+template <typename T>
+inline void print_value(PrintBuffer& buffer, const T& value) {
+    format_value([&buffer](const char* data, std::size_t size) { print_append(buffer, data, size); }, value);
+}
+}
+
+template<typename... Args>
+static inline void print(Args&&... args) {
+    global_detail::PrintBuffer& buffer = global_detail::get_print_buffer();
+    (global_detail::print_value(buffer, args), ...);
+    if (buffer.mode == global_detail::PRINT_DIRECT) global_detail::print_flush(buffer);
+}
+
+template <typename Arg, typename... Args>
+static inline void printl(Arg&& arg, Args&&... args) {
+    global_detail::PrintBuffer& buffer = global_detail::get_print_buffer();
+    global_detail::print_value(buffer, arg);
+    ((global_detail::print_append(buffer, " ", 1), global_detail::print_value(buffer, args)), ...);
+    global_detail::print_append(buffer, "\n", 1);
+    if (buffer.mode == global_detail::PRINT_DIRECT) global_detail::print_flush(buffer);
+}
+
+// Writes what this thread has printed so far, and then this, in one piece
+template<typename... Args>
+static inline void print_sync(Args&&... args) {
+    global_detail::PrintBuffer& buffer = global_detail::get_print_buffer();
+    global_detail::print_flush(buffer);
+    (global_detail::print_value(buffer, args), ...);
+    global_detail::print_flush(buffer);
+}
+
+static inline void print_flush() {
+    global_detail::print_flush(global_detail::get_print_buffer());
+}
+#ifdef __clang__
+#pragma GCC diagnostic pop
+#endif // "-Wc++98-compat" (print: fold, thread_local)
+#pragma GCC diagnostic pop
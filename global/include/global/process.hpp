@@ -0,0 +1,35 @@
+#pragma once
+#include <cstddef>
+#include <cstdio>
+#include <string>
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wunused-function"
+#ifdef __clang__
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wc++98-compat"
+#endif
+// Returns the result of system() call, _popen for Windows compatibility
+static std::string syscall(const char* const cmd) {
+    std::string ret = "";
+    FILE* fpipe;
+    #ifdef _WIN32
+    fpipe = _popen(cmd, "r");
+    #else
+    fpipe = popen(cmd, "r");
+    #endif
+    if (fpipe == nullptr) return ret;
+    char chunk[64 * 1024];
+    std::size_t length;
+    while ((length = fread(chunk, 1, sizeof(chunk), fpipe)) > 0) ret.append(chunk, length);
+    #ifdef _WIN32
+    _pclose(fpipe);
+    #else
+    pclose(fpipe);
+    #endif
+    return ret;
+}
+#ifdef __clang__
+#pragma GCC diagnostic pop
+#endif // "-Wc++98-compat" (syscall: nullptr)
+#pragma GCC diagnostic pop
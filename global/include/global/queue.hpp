@@ -0,0 +1,370 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <thread>
+#include <utility>
+
+#ifdef __clang__
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wc++98-compat"
+#pragma GCC diagnostic ignored "-Wunused-template"
+#endif
+namespace global_detail {
+// A power of 2, and at least 2 for MpmcQueue's sequence numbers to tell a full slot from an empty one
+inline std::size_t queue_capacity(std::size_t capacity) {
+    std::size_t rounded = 2;
+    while (rounded < capacity) rounded *= 2;
+    return rounded;
+}
+
+// Room for one T, constructed and destroyed by the queues
+template <typename T>
+struct QueueSlot {
+    alignas(T) unsigned char data[sizeof(T)];
+    T* get() { return std::launder(reinterpret_cast<T*>(data)); }
+};
+}
+
+// Bounded lock-free queue for one thread pushing and one popping, like input events to a render thread.
+// The capacity is rounded up to a power of 2 (at least 2). Each thread's index is on its own cache line
+// with a copy of the other one, which it only reads again when the queue looks full or empty, so the
+// threads rarely touch the same line. try_push() and try_pop() fail instead of waiting, BlockingQueue waits.
+template <typename T>
+class alignas(64) SpscQueue {
+public:
+    using value_type = T;
+
+    explicit SpscQueue(std::size_t capacity)
+        : mask(global_detail::queue_capacity(capacity) - 1), slots(new global_detail::QueueSlot<T>[mask + 1]) {}
+    SpscQueue(const SpscQueue&) = delete;
+    SpscQueue& operator=(const SpscQueue&) = delete;
+    ~SpscQueue() {
+        for (std::size_t i = head.load(std::memory_order_relaxed); i != tail.load(std::memory_order_relaxed); i++) slot(i)->~T();
+    }
+
+    // Only from the producer
+    template <typename... Args>
+    bool try_emplace(Args&&... args) {
+        std::size_t back = tail.load(std::memory_order_relaxed);
+        if (back - cached_head > mask) {
+            cached_head = head.load(std::memory_order_acquire);
+            if (back - cached_head > mask) return false;
+        }
+        new (slots[back & mask].data) T(std::forward<Args>(args)...);
+        tail.store(back + 1, std::memory_order_release);
+        return true;
+    }
+    bool try_push(const T& value) { return try_emplace(value); }
+    bool try_push(T&& value) { return try_emplace(std::move(value)); }
+
+    // Pushes as many of values as fit, in one step for the consumer, and returns how many
+    std::size_t try_push_batch(const T* values, std::size_t count) {
+        std::size_t back = tail.load(std::memory_order_relaxed);
+        if (mask + 1 - (back - cached_head) < count) cached_head = head.load(std::memory_order_acquire);
+        std::size_t pushed = std::min(count, mask + 1 - (back - cached_head));
+        for (std::size_t i = 0; i < pushed; i++) new (slots[(back + i) & mask].data) T(values[i]);
+        if (pushed > 0) tail.store(back + pushed, std::memory_order_release);
+        return pushed;
+    }
+
+    // Only from the consumer
+    bool try_pop(T& value) {
+        std::size_t front = head.load(std::memory_order_relaxed);
+        if (front == cached_tail) {
+            cached_tail = tail.load(std::memory_order_acquire);
+            if (front == cached_tail) return false;
+        }
+        T* item = slot(front);
+        value = std::move(*item);
+        item->~T();
+        head.store(front + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Pops up to count into values and returns how many
+    std::size_t try_pop_batch(T* values, std::size_t count) {
+        std::size_t front = head.load(std::memory_order_relaxed);
+        if (cached_tail - front < count) cached_tail = tail.load(std::memory_order_acquire);
+        std::size_t popped = std::min(count, cached_tail - front);
+        for (std::size_t i = 0; i < popped; i++) {
+            T* item = slot(front + i);
+            values[i] = std::move(*item);
+            item->~T();
+        }
+        if (popped > 0) head.store(front + popped, std::memory_order_release);
+        return popped;
+    }
+
+    // Only exact when neither thread is using it
+    std::size_t size() const {
+        std::size_t front = head.load(std::memory_order_acquire);
+        return tail.load(std::memory_order_acquire) - front;
+    }
+    bool empty() const { return size() == 0; }
+    std::size_t capacity() const { return mask + 1; }
+
+private:
+    T* slot(std::size_t index) { return slots[index & mask].get(); }
+
+    const std::size_t mask;
+    std::unique_ptr<global_detail::QueueSlot<T>[]> slots;
+    alignas(64) std::atomic<std::size_t> head{ 0 };     // The consumer's line
+    std::size_t cached_tail = 0;
+    alignas(64) std::atomic<std::size_t> tail{ 0 };     // The producer's line
+    std::size_t cached_head = 0;
+};
+
+// Bounded lock-free queue for any number of threads pushing and popping (Vyukov's design): every slot
+// has a sequence number that says whose turn it is, so a push or pop is one compare-and-swap on its
+// index and threads only wait on each other while they're claiming the same slot. The capacity is
+// rounded up to a power of 2 (at least 2), and the two indices are on cache lines of their own.
+// Batches claim consecutive slots with a single compare-and-swap.
+template <typename T>
+class alignas(64) MpmcQueue {
+public:
+    using value_type = T;
+
+    explicit MpmcQueue(std::size_t capacity)
+        : mask(global_detail::queue_capacity(capacity) - 1), cells(new Cell[mask + 1]) {
+        for (std::size_t i = 0; i <= mask; i++) cells[i].sequence.store(i, std::memory_order_relaxed);
+    }
+    MpmcQueue(const MpmcQueue&) = delete;
+    MpmcQueue& operator=(const MpmcQueue&) = delete;
+    ~MpmcQueue() {
+        for (std::size_t i = dequeue_index.load(std::memory_order_relaxed); i != enqueue_index.load(std::memory_order_relaxed); i++) {
+            cells[i & mask].slot.get()->~T();
+        }
+    }
+
+    template <typename... Args>
+    bool try_emplace(Args&&... args) {
+        std::size_t index = enqueue_index.load(std::memory_order_relaxed);
+        for (;;) {
+            Cell& cell = cells[index & mask];
+            std::size_t sequence = cell.sequence.load(std::memory_order_acquire);
+            if (sequence == index) {
+                if (enqueue_index.compare_exchange_weak(index, index + 1, std::memory_order_relaxed)) {
+                    new (cell.slot.data) T(std::forward<Args>(args)...);
+                    cell.sequence.store(index + 1, std::memory_order_release);
+                    return true;
+                }
+            }
+            else if (before(sequence, index)) return false;     // Not popped since the last lap, full
+            else index = enqueue_index.load(std::memory_order_relaxed);
+        }
+    }
+    bool try_push(const T& value) { return try_emplace(value); }
+    bool try_push(T&& value) { return try_emplace(std::move(value)); }
+
+    // Pushes as many of values as there are free slots in a row, and returns how many
+    std::size_t try_push_batch(const T* values, std::size_t count) {
+        if (count == 0) return 0;
+        std::size_t index = enqueue_index.load(std::memory_order_relaxed);
+        for (;;) {
+            std::size_t free = 0;
+            while (free < count && cells[(index + free) & mask].sequence.load(std::memory_order_acquire) == index + free) free++;
+            if (free == 0) {
+                if (before(cells[index & mask].sequence.load(std::memory_order_acquire), index)) return 0;
+                index = enqueue_index.load(std::memory_order_relaxed);
+            }
+            else if (enqueue_index.compare_exchange_weak(index, index + free, std::memory_order_relaxed)) {
+                for (std::size_t i = 0; i < free; i++) {
+                    Cell& cell = cells[(index + i) & mask];
+                    new (cell.slot.data) T(values[i]);
+                    cell.sequence.store(index + i + 1, std::memory_order_release);
+                }
+                return free;
+            }
+        }
+    }
+
+    bool try_pop(T& value) {
+        std::size_t index = dequeue_index.load(std::memory_order_relaxed);
+        for (;;) {
+            Cell& cell = cells[index & mask];
+            std::size_t sequence = cell.sequence.load(std::memory_order_acquire);
+            if (sequence == index + 1) {
+                if (dequeue_index.compare_exchange_weak(index, index + 1, std::memory_order_relaxed)) {
+                    T* item = cell.slot.get();
+                    value = std::move(*item);
+                    item->~T();
+                    cell.sequence.store(index + mask + 1, std::memory_order_release);
+                    return true;
+                }
+            }
+            else if (before(sequence, index + 1)) return false;     // Not pushed yet, empty
+            else index = dequeue_index.load(std::memory_order_relaxed);
+        }
+    }
+
+    // Pops up to count of the values that are ready in a row, and returns how many
+    std::size_t try_pop_batch(T* values, std::size_t count) {
+        if (count == 0) return 0;
+        std::size_t index = dequeue_index.load(std::memory_order_relaxed);
+        for (;;) {
+            std::size_t ready = 0;
+            while (ready < count && cells[(index + ready) & mask].sequence.load(std::memory_order_acquire) == index + ready + 1) ready++;
+            if (ready == 0) {
+                if (before(cells[index & mask].sequence.load(std::memory_order_acquire), index + 1)) return 0;
+                index = dequeue_index.load(std::memory_order_relaxed);
+            }
+            else if (dequeue_index.compare_exchange_weak(index, index + ready, std::memory_order_relaxed)) {
+                for (std::size_t i = 0; i < ready; i++) {
+                    Cell& cell = cells[(index + i) & mask];
+                    T* item = cell.slot.get();
+                    values[i] = std::move(*item);
+                    item->~T();
+                    cell.sequence.store(index + i + mask + 1, std::memory_order_release);
+                }
+                return ready;
+            }
+        }
+    }
+
+    // Only exact when no thread is using it
+    std::size_t size() const {
+        std::size_t front = dequeue_index.load(std::memory_order_acquire), back = enqueue_index.load(std::memory_order_acquire);
+        return before(front, back) ? std::min(back - front, mask + 1) : 0;
+    }
+    bool empty() const { return size() == 0; }
+    std::size_t capacity() const { return mask + 1; }
+
+private:
+    struct Cell {
+        std::atomic<std::size_t> sequence;
+        global_detail::QueueSlot<T> slot;
+    };
+
+    // a < b, for indices that wrap around
+    static bool before(std::size_t a, std::size_t b) { return static_cast<std::ptrdiff_t>(a - b) < 0; }
+
+    const std::size_t mask;
+    std::unique_ptr<Cell[]> cells;
+    alignas(64) std::atomic<std::size_t> enqueue_index{ 0 };
+    alignas(64) std::atomic<std::size_t> dequeue_index{ 0 };
+};
+
+// SpscQueue or MpmcQueue that waits instead of failing: push() while it's full and pop() while it's empty.
+// They retry for a while before sleeping, and a push or pop only locks to wake threads that are asleep.
+// close() when nothing pushes anymore: the threads waiting wake up, push() fails and pop() fails once
+// the queue is empty. BlockingQueue<MpmcQueue<Job>> jobs(1024); while (jobs.pop(job)) run(job);
+template <typename Queue>
+class BlockingQueue {
+public:
+    using value_type = typename Queue::value_type;
+
+    explicit BlockingQueue(std::size_t capacity) : queue(capacity) {}
+    BlockingQueue(const BlockingQueue&) = delete;
+    BlockingQueue& operator=(const BlockingQueue&) = delete;
+
+    bool push(value_type value) {
+        if (closed.load(std::memory_order_acquire)) return false;
+        if (!wait(producers_waiting, not_full, [&]() { return queue.try_push(std::move(value)); })) return false;
+        wake(consumers_waiting, not_empty, false);
+        return true;
+    }
+
+    // Pushes all of values, waiting for room as often as it has to. False if it's closed first
+    bool push_batch(const value_type* values, std::size_t count) {
+        if (closed.load(std::memory_order_acquire)) return false;
+        while (count > 0) {
+            std::size_t pushed = 0;
+            if (!wait(producers_waiting, not_full, [&]() { return (pushed = queue.try_push_batch(values, count)) > 0; })) return false;
+            wake(consumers_waiting, not_empty, true);
+            values += pushed;
+            count -= pushed;
+        }
+        return true;
+    }
+
+    bool pop(value_type& value) {
+        if (!wait(consumers_waiting, not_empty, [&]() { return queue.try_pop(value); })) return false;
+        wake(producers_waiting, not_full, false);
+        return true;
+    }
+
+    // Waits for at least one value and pops up to count, 0 once it's closed and empty
+    std::size_t pop_batch(value_type* values, std::size_t count) {
+        std::size_t popped = 0;
+        if (count == 0 || !wait(consumers_waiting, not_empty, [&]() { return (popped = queue.try_pop_batch(values, count)) > 0; })) return 0;
+        wake(producers_waiting, not_full, true);
+        return popped;
+    }
+
+    bool try_push(value_type value) {
+        if (closed.load(std::memory_order_acquire) || !queue.try_push(std::move(value))) return false;
+        wake(consumers_waiting, not_empty, false);
+        return true;
+    }
+
+    bool try_pop(value_type& value) {
+        if (!queue.try_pop(value)) return false;
+        wake(producers_waiting, not_full, false);
+        return true;
+    }
+
+    void close() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            closed.store(true, std::memory_order_release);
+        }
+        not_full.notify_all();
+        not_empty.notify_all();
+    }
+
+    bool is_closed() const { return closed.load(std::memory_order_acquire); }
+    std::size_t size() const { return queue.size(); }
+    bool empty() const { return queue.empty(); }
+    std::size_t capacity() const { return queue.capacity(); }
+
+private:
+    // Tries attempt() until it succeeds, sleeping on condition after a while. False if it's closed first
+    template <typename F>
+    bool wait(std::atomic<int>& waiting, std::condition_variable& condition, F&& attempt) {
+        // Once it's closed everything pushed before is visible, so one more attempt drains the queue
+        for (int spins = 0; spins < 64; spins++) {
+            if (attempt()) return true;
+            if (closed.load(std::memory_order_acquire)) return attempt();
+            std::this_thread::yield();
+        }
+        std::unique_lock<std::mutex> lock(mutex);
+        waiting.fetch_add(1);
+        // Pairs with the fence in wake(): either it sees this thread waiting, or attempt() sees its change
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        bool done = attempt();
+        while (!done) {
+            if (closed.load(std::memory_order_acquire)) {
+                done = attempt();
+                break;
+            }
+            condition.wait(lock);
+            done = attempt();
+        }
+        waiting.fetch_sub(1);
+        return done;
+    }
+
+    void wake(std::atomic<int>& waiting, std::condition_variable& condition, bool all) {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (waiting.load(std::memory_order_relaxed) == 0) return;
+        { std::lock_guard<std::mutex> lock(mutex); }
+        if (all) condition.notify_all();
+        else condition.notify_one();
+    }
+
+    Queue queue;
+    std::atomic<bool> closed{ false };
+    std::atomic<int> producers_waiting{ 0 };
+    std::atomic<int> consumers_waiting{ 0 };
+    std::mutex mutex;
+    std::condition_variable not_full;
+    std::condition_variable not_empty;
+};
+#ifdef __clang__
+#pragma GCC diagnostic pop
+#endif // "-Wc++98-compat" (queues: atomics, lambdas)
@@ -0,0 +1,195 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <thread>
+#include <type_traits>
+#include "types.hpp"
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wunused-function"
+#ifdef __clang__
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wc++98-compat"
+#pragma GCC diagnostic ignored "-Wc++98-compat-pedantic"
+#pragma GCC diagnostic ignored "-Wunused-template"
+#endif
+// xoshiro256** (Blackman and Vigna), fast and good enough for anything but cryptography.
+// Works with the standard distributions and algorithms, e.g. std::shuffle(v.begin(), v.end(), rng_engine()).
+struct Xoshiro256 {
+    using result_type = u64;
+    u64 s[4];
+
+    static constexpr u64 splitmix64(u64& x) {
+        u64 z = (x += 0x9E3779B97F4A7C15ULL);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+        return z ^ (z >> 31);
+    }
+    static constexpr u64 rotl(u64 x, int k) { return (x << k) | (x >> (64 - k)); }
+    static constexpr result_type min() { return 0; }
+    static constexpr result_type max() { return ~0ULL; }
+
+    explicit Xoshiro256(u64 seed = 0) : s() { this->seed(seed); }
+
+    // The same seed gives the same numbers, on every platform
+    void seed(u64 seed) {
+        for (u64& x : s) x = splitmix64(seed);
+    }
+
+    u64 operator()() {
+        u64 result = rotl(s[1] * 5, 7) * 9;
+        u64 t = s[1] << 17;
+        s[2] ^= s[0];
+        s[3] ^= s[1];
+        s[1] ^= s[2];
+        s[0] ^= s[3];
+        s[2] ^= t;
+        s[3] = rotl(s[3], 45);
+        return result;
+    }
+
+    // [0, range) without bias, range > 0, with one multiplication (Lemire's method)
+    std::uint32_t bounded(std::uint32_t range) {
+        u64 m = static_cast<u64>(static_cast<std::uint32_t>((*this)() >> 32)) * range;
+        if (static_cast<std::uint32_t>(m) < range) {
+            std::uint32_t threshold = (0U - range) % range;
+            while (static_cast<std::uint32_t>(m) < threshold) m = static_cast<u64>(static_cast<std::uint32_t>((*this)() >> 32)) * range;
+        }
+        return static_cast<std::uint32_t>(m >> 32);
+    }
+
+    // [0, 1) with 53 random bits
+    double uniform() { return static_cast<double>((*this)() >> 11) * 0x1.0p-53; }
+};
+
+namespace global_detail {
+// One engine per thread, the others are 4 independent streams for rng_fill() to vectorize
+struct RngState {
+    Xoshiro256 engine;
+    u64 lanes[4][4];    // [state word][lane]
+    bool seeded;
+};
+inline thread_local RngState rng_state;
+inline std::atomic<u64> rng_threads{ 0 };
+
+inline void seed_rng_state(RngState& state, u64 seed) {
+    state.engine.seed(seed);
+    for (int lane = 0; lane < 4; lane++) {
+        u64 lane_seed = state.engine();
+        for (int i = 0; i < 4; i++) state.lanes[i][lane] = Xoshiro256::splitmix64(lane_seed);
+    }
+    state.seeded = true;
+}
+
+// Threads that don't call rng_seed() get a different seed each, without asking the OS
+inline RngState& get_rng_state() {
+    RngState& state = rng_state;
+    if (!state.seeded) {
+        u64 seed = static_cast<u64>(std::chrono::high_resolution_clock::now().time_since_epoch().count());
+        seed ^= Xoshiro256::rotl(rng_threads.fetch_add(1, std::memory_order_relaxed) * 0x9E3779B97F4A7C15ULL, 32);
+        seed ^= static_cast<u64>(reinterpret_cast<std::uintptr_t>(&state));
+        seed_rng_state(state, seed);
+    }
+    return state;
+}
+
+// The same steps as Xoshiro256, on 4 streams at a time so the compiler can use vector instructions
+inline void rng_lanes(u64 (&s)[4][4], u64* out) {
+    for (int lane = 0; lane < 4; lane++) {
+        u64 x = s[1][lane] * 5;
+        out[lane] = ((x << 7) | (x >> 57)) * 9;
+        u64 t = s[1][lane] << 17;
+        s[2][lane] ^= s[0][lane];
+        s[3][lane] ^= s[1][lane];
+        s[1][lane] ^= s[2][lane];
+        s[0][lane] ^= s[3][lane];
+        s[2][lane] ^= t;
+        s[3][lane] = (s[3][lane] << 45) | (s[3][lane] >> 19);
+    }
+}
+}
+
+// The calling thread's engine, to use with the standard library
+static Xoshiro256& rng_engine() {
+    return global_detail::get_rng_state().engine;
+}
+
+// Makes the calling thread's numbers reproducible, seed every thread that needs it
+static void rng_seed(u64 seed) {
+    global_detail::seed_rng_state(global_detail::rng_state, seed);
+}
+
+// [lower_bound, upper_bound]
+static int rng(int lower_bound, int upper_bound) {
+    Xoshiro256& engine = rng_engine();
+    u64 range = static_cast<u64>(static_cast<s64>(upper_bound) - lower_bound) + 1;
+    if (range > 0xFFFFFFFFULL) return static_cast<int>(static_cast<std::uint32_t>(engine() >> 32));
+    return static_cast<int>(lower_bound + static_cast<s64>(engine.bounded(static_cast<std::uint32_t>(range))));
+}
+
+// [0, 1)
+static double rng() {
+    return rng_engine().uniform();
+}
+
+// Fills with random bits, 4 streams at a time
+static void rng_fill(u64* data, std::size_t count) {
+    global_detail::RngState& state = global_detail::get_rng_state();
+    u64 lanes[4][4];    // A local copy, since data could point to the state as far as the compiler knows
+    std::memcpy(lanes, state.lanes, sizeof(lanes));
+    std::size_t i = 0;
+    for (; i + 4 <= count; i += 4) global_detail::rng_lanes(lanes, data + i);
+    for (; i < count; i++) data[i] = state.engine();
+    std::memcpy(state.lanes, lanes, sizeof(lanes));
+}
+
+// Fills with [0, 1), with 52 random bits each
+static void rng_fill(double* data, std::size_t count) {
+    static_assert(sizeof(double) == sizeof(u64), "rng_fill needs 64-bit doubles");
+    u64 chunk[256];
+    for (std::size_t start = 0; start < count; start += 256) {
+        std::size_t size = std::min<std::size_t>(256, count - start);
+        rng_fill(chunk, size);
+        // The bits of a double in [1, 2), converting the integer doesn't vectorize without AVX-512
+        for (std::size_t i = 0; i < size; i++) chunk[i] = (chunk[i] >> 12) | 0x3FF0000000000000ULL;
+        std::memcpy(data + start, chunk, size * sizeof(double));
+        for (std::size_t i = 0; i < size; i++) data[start + i] -= 1.0;
+    }
+}
+
+// Fills with [lower_bound, upper_bound], like rng(lower_bound, upper_bound)
+static void rng_fill(int* data, std::size_t count, int lower_bound, int upper_bound) {
+    global_detail::RngState& state = global_detail::get_rng_state();
+    u64 range = static_cast<u64>(static_cast<s64>(upper_bound) - lower_bound) + 1;
+    u64 chunk[256];
+    for (std::size_t start = 0; start < count; start += 256) {
+        std::size_t size = std::min<std::size_t>(256, count - start);
+        rng_fill(chunk, size);
+        if (range > 0xFFFFFFFFULL) {
+            for (std::size_t i = 0; i < size; i++) data[start + i] = static_cast<int>(static_cast<std::uint32_t>(chunk[i] >> 32));
+            continue;
+        }
+        // Lemire's method, the rare rejected values are drawn again from the thread's engine
+        std::uint32_t range32 = static_cast<std::uint32_t>(range);
+        std::uint32_t threshold = (0U - range32) % range32;
+        for (std::size_t i = 0; i < size; i++) {
+            u64 m = (chunk[i] >> 32) * range32;
+            while (static_cast<std::uint32_t>(m) < threshold) m = (state.engine() >> 32) * range32;
+            data[start + i] = static_cast<int>(static_cast<s64>(lower_bound) + static_cast<s64>(m >> 32));
+        }
+    }
+}
+
+// Any contiguous container of u64, double or int, e.g. rng_fill(vec) or rng_fill(vec, 1, 6)
+template <typename Container, typename... Args>
+static auto rng_fill(Container& container, Args... args) -> decltype(rng_fill(container.data(), container.size(), args...)) {
+    rng_fill(container.data(), container.size(), args...);
+}
+#ifdef __clang__
+#pragma GCC diagnostic pop
+#endif // "-Wc++98-compat" (rng: constexpr, thread_local, atomic)
+#pragma GCC diagnostic pop
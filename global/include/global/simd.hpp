@@ -0,0 +1,482 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include "platform.hpp"
+#if GLOBAL_SIMD == GLOBAL_SIMD_SSE && defined(__SSE4_1__)
+#include <smmintrin.h>
+#endif
+
+#ifdef __clang__
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wc++98-compat"
+#pragma GCC diagnostic ignored "-Wunused-template"
+#endif
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wunused-function"
+// SimdFloat and SimdInt hold SimdFloat::size floats or 32-bit ints: 16 with AVX-512, 8 with AVX2, 4 with SSE,
+// NEON and the scalar fallback. The backend is the widest one the compiler targets (-march=native),
+// or the one GLOBAL_SIMD is defined as before including this. Loops step by size and finish with a partial load:
+//     SimdFloat total = 0.0f;
+//     for (std::size_t i = 0; i < n; i += SimdFloat::size) total += SimdFloat::load(data + i, n - i);
+//     float sum = reduce_add(total);
+namespace global_detail {
+namespace simd {
+#if GLOBAL_SIMD == GLOBAL_SIMD_AVX512
+constexpr int WIDTH = 16;
+constexpr const char* NAME = "AVX-512";
+typedef __m512 Float;
+typedef __m512i Int;
+typedef __mmask16 Mask;
+
+inline Float load(const float* p) { return _mm512_loadu_ps(p); }
+inline void store(float* p, Float a) { _mm512_storeu_ps(p, a); }
+inline Float broadcast(float value) { return _mm512_set1_ps(value); }
+inline Float add(Float a, Float b) { return _mm512_add_ps(a, b); }
+inline Float sub(Float a, Float b) { return _mm512_sub_ps(a, b); }
+inline Float mul(Float a, Float b) { return _mm512_mul_ps(a, b); }
+inline Float div(Float a, Float b) { return _mm512_div_ps(a, b); }
+inline Float min(Float a, Float b) { return _mm512_min_ps(a, b); }
+inline Float max(Float a, Float b) { return _mm512_max_ps(a, b); }
+inline Float sqrt(Float a) { return _mm512_sqrt_ps(a); }
+inline Float fma(Float a, Float b, Float c) { return _mm512_fmadd_ps(a, b, c); }
+inline Mask eq(Float a, Float b) { return _mm512_cmp_ps_mask(a, b, _CMP_EQ_OQ); }
+inline Mask lt(Float a, Float b) { return _mm512_cmp_ps_mask(a, b, _CMP_LT_OQ); }
+inline Mask le(Float a, Float b) { return _mm512_cmp_ps_mask(a, b, _CMP_LE_OQ); }
+inline Float select(Mask m, Float a, Float b) { return _mm512_mask_blend_ps(m, b, a); }
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wsign-conversion"   // In GCC's macro versions of the gathers, without optimization
+inline Float gather(const float* base, Int indices) { return _mm512_i32gather_ps(indices, base, 4); }
+inline Int gather(const std::int32_t* base, Int indices) { return _mm512_i32gather_epi32(indices, base, 4); }
+#pragma GCC diagnostic pop
+inline Int to_int(Float a) { return _mm512_cvttps_epi32(a); }
+inline Float to_float(Int a) { return _mm512_cvtepi32_ps(a); }
+
+inline Int load(const std::int32_t* p) { return _mm512_loadu_si512(p); }
+inline void store(std::int32_t* p, Int a) { _mm512_storeu_si512(p, a); }
+inline Int broadcast(std::int32_t value) { return _mm512_set1_epi32(value); }
+inline Int add(Int a, Int b) { return _mm512_add_epi32(a, b); }
+inline Int sub(Int a, Int b) { return _mm512_sub_epi32(a, b); }
+inline Int mul(Int a, Int b) { return _mm512_mullo_epi32(a, b); }
+inline Int min(Int a, Int b) { return _mm512_min_epi32(a, b); }
+inline Int max(Int a, Int b) { return _mm512_max_epi32(a, b); }
+inline Int bit_and(Int a, Int b) { return _mm512_and_si512(a, b); }
+inline Int bit_or(Int a, Int b) { return _mm512_or_si512(a, b); }
+inline Int bit_xor(Int a, Int b) { return _mm512_xor_si512(a, b); }
+inline Int shift_left(Int a, int bits) { return _mm512_sll_epi32(a, _mm_cvtsi32_si128(bits)); }
+inline Int shift_right(Int a, int bits) { return _mm512_sra_epi32(a, _mm_cvtsi32_si128(bits)); }
+inline Mask eq(Int a, Int b) { return _mm512_cmpeq_epi32_mask(a, b); }
+inline Mask lt(Int a, Int b) { return _mm512_cmplt_epi32_mask(a, b); }
+inline Int select(Mask m, Int a, Int b) { return _mm512_mask_blend_epi32(m, b, a); }
+
+inline Mask mask_and(Mask a, Mask b) { return static_cast<Mask>(a & b); }
+inline Mask mask_or(Mask a, Mask b) { return static_cast<Mask>(a | b); }
+inline Mask mask_not(Mask a) { return static_cast<Mask>(~a); }
+inline unsigned mask_bits(Mask a) { return a; }
+
+#elif GLOBAL_SIMD == GLOBAL_SIMD_AVX2
+constexpr int WIDTH = 8;
+constexpr const char* NAME = "AVX2";
+typedef __m256 Float;
+typedef __m256i Int;
+typedef __m256i Mask;   // All bits of a lane set or clear
+
+inline Float load(const float* p) { return _mm256_loadu_ps(p); }
+inline void store(float* p, Float a) { _mm256_storeu_ps(p, a); }
+inline Float broadcast(float value) { return _mm256_set1_ps(value); }
+inline Float add(Float a, Float b) { return _mm256_add_ps(a, b); }
+inline Float sub(Float a, Float b) { return _mm256_sub_ps(a, b); }
+inline Float mul(Float a, Float b) { return _mm256_mul_ps(a, b); }
+inline Float div(Float a, Float b) { return _mm256_div_ps(a, b); }
+inline Float min(Float a, Float b) { return _mm256_min_ps(a, b); }
+inline Float max(Float a, Float b) { return _mm256_max_ps(a, b); }
+inline Float sqrt(Float a) { return _mm256_sqrt_ps(a); }
+#ifdef __FMA__
+inline Float fma(Float a, Float b, Float c) { return _mm256_fmadd_ps(a, b, c); }
+#else
+inline Float fma(Float a, Float b, Float c) { return _mm256_add_ps(_mm256_mul_ps(a, b), c); }
+#endif
+inline Mask eq(Float a, Float b) { return _mm256_castps_si256(_mm256_cmp_ps(a, b, _CMP_EQ_OQ)); }
+inline Mask lt(Float a, Float b) { return _mm256_castps_si256(_mm256_cmp_ps(a, b, _CMP_LT_OQ)); }
+inline Mask le(Float a, Float b) { return _mm256_castps_si256(_mm256_cmp_ps(a, b, _CMP_LE_OQ)); }
+inline Float select(Mask m, Float a, Float b) { return _mm256_blendv_ps(b, a, _mm256_castsi256_ps(m)); }
+inline Float gather(const float* base, Int indices) { return _mm256_i32gather_ps(base, indices, 4); }
+inline Int to_int(Float a) { return _mm256_cvttps_epi32(a); }
+inline Float to_float(Int a) { return _mm256_cvtepi32_ps(a); }
+
+inline Int load(const std::int32_t* p) { return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p)); }
+inline void store(std::int32_t* p, Int a) { _mm256_storeu_si256(reinterpret_cast<__m256i*>(p), a); }
+inline Int broadcast(std::int32_t value) { return _mm256_set1_epi32(value); }
+inline Int add(Int a, Int b) { return _mm256_add_epi32(a, b); }
+inline Int sub(Int a, Int b) { return _mm256_sub_epi32(a, b); }
+inline Int mul(Int a, Int b) { return _mm256_mullo_epi32(a, b); }
+inline Int min(Int a, Int b) { return _mm256_min_epi32(a, b); }
+inline Int max(Int a, Int b) { return _mm256_max_epi32(a, b); }
+inline Int bit_and(Int a, Int b) { return _mm256_and_si256(a, b); }
+inline Int bit_or(Int a, Int b) { return _mm256_or_si256(a, b); }
+inline Int bit_xor(Int a, Int b) { return _mm256_xor_si256(a, b); }
+inline Int shift_left(Int a, int bits) { return _mm256_sll_epi32(a, _mm_cvtsi32_si128(bits)); }
+inline Int shift_right(Int a, int bits) { return _mm256_sra_epi32(a, _mm_cvtsi32_si128(bits)); }
+inline Mask eq(Int a, Int b) { return _mm256_cmpeq_epi32(a, b); }
+inline Mask lt(Int a, Int b) { return _mm256_cmpgt_epi32(b, a); }
+inline Int select(Mask m, Int a, Int b) { return _mm256_blendv_epi8(b, a, m); }
+inline Int gather(const std::int32_t* base, Int indices) { return _mm256_i32gather_epi32(base, indices, 4); }
+
+inline Mask mask_and(Mask a, Mask b) { return _mm256_and_si256(a, b); }
+inline Mask mask_or(Mask a, Mask b) { return _mm256_or_si256(a, b); }
+inline Mask mask_not(Mask a) { return _mm256_xor_si256(a, _mm256_set1_epi32(-1)); }
+inline unsigned mask_bits(Mask a) { return static_cast<unsigned>(_mm256_movemask_ps(_mm256_castsi256_ps(a))); }
+
+#elif GLOBAL_SIMD == GLOBAL_SIMD_SSE
+constexpr int WIDTH = 4;
+constexpr const char* NAME = "SSE";
+typedef __m128 Float;
+typedef __m128i Int;
+typedef __m128i Mask;   // All bits of a lane set or clear
+
+inline Float load(const float* p) { return _mm_loadu_ps(p); }
+inline void store(float* p, Float a) { _mm_storeu_ps(p, a); }
+inline Float broadcast(float value) { return _mm_set1_ps(value); }
+inline Float add(Float a, Float b) { return _mm_add_ps(a, b); }
+inline Float sub(Float a, Float b) { return _mm_sub_ps(a, b); }
+inline Float mul(Float a, Float b) { return _mm_mul_ps(a, b); }
+inline Float div(Float a, Float b) { return _mm_div_ps(a, b); }
+inline Float min(Float a, Float b) { return _mm_min_ps(a, b); }
+inline Float max(Float a, Float b) { return _mm_max_ps(a, b); }
+inline Float sqrt(Float a) { return _mm_sqrt_ps(a); }
+#ifdef __FMA__
+inline Float fma(Float a, Float b, Float c) { return _mm_fmadd_ps(a, b, c); }
+#else
+inline Float fma(Float a, Float b, Float c) { return _mm_add_ps(_mm_mul_ps(a, b), c); }
+#endif
+inline Mask eq(Float a, Float b) { return _mm_castps_si128(_mm_cmpeq_ps(a, b)); }
+inline Mask lt(Float a, Float b) { return _mm_castps_si128(_mm_cmplt_ps(a, b)); }
+inline Mask le(Float a, Float b) { return _mm_castps_si128(_mm_cmple_ps(a, b)); }
+inline Float select(Mask m, Float a, Float b) {
+    Float mask = _mm_castsi128_ps(m);
+    return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+}
+inline Int to_int(Float a) { return _mm_cvttps_epi32(a); }
+inline Float to_float(Int a) { return _mm_cvtepi32_ps(a); }
+
+inline Int load(const std::int32_t* p) { return _mm_loadu_si128(reinterpret_cast<const __m128i*>(p)); }
+inline void store(std::int32_t* p, Int a) { _mm_storeu_si128(reinterpret_cast<__m128i*>(p), a); }
+inline Int broadcast(std::int32_t value) { return _mm_set1_epi32(value); }
+inline Int add(Int a, Int b) { return _mm_add_epi32(a, b); }
+inline Int sub(Int a, Int b) { return _mm_sub_epi32(a, b); }
+inline Int bit_and(Int a, Int b) { return _mm_and_si128(a, b); }
+inline Int bit_or(Int a, Int b) { return _mm_or_si128(a, b); }
+inline Int bit_xor(Int a, Int b) { return _mm_xor_si128(a, b); }
+inline Int shift_left(Int a, int bits) { return _mm_sll_epi32(a, _mm_cvtsi32_si128(bits)); }
+inline Int shift_right(Int a, int bits) { return _mm_sra_epi32(a, _mm_cvtsi32_si128(bits)); }
+inline Mask eq(Int a, Int b) { return _mm_cmpeq_epi32(a, b); }
+inline Mask lt(Int a, Int b) { return _mm_cmplt_epi32(a, b); }
+inline Int select(Mask m, Int a, Int b) { return _mm_or_si128(_mm_and_si128(m, a), _mm_andnot_si128(m, b)); }
+#ifdef __SSE4_1__
+inline Int mul(Int a, Int b) { return _mm_mullo_epi32(a, b); }
+inline Int min(Int a, Int b) { return _mm_min_epi32(a, b); }
+inline Int max(Int a, Int b) { return _mm_max_epi32(a, b); }
+#else
+// SSE2 only multiplies lanes 0 and 2 into 64 bits, so lanes 1 and 3 are shifted down to do them too
+inline Int mul(Int a, Int b) {
+    Int even = _mm_mul_epu32(a, b);
+    Int odd = _mm_mul_epu32(_mm_srli_epi64(a, 32), _mm_srli_epi64(b, 32));
+    return _mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(0, 0, 2, 0)), _mm_shuffle_epi32(odd, _MM_SHUFFLE(0, 0, 2, 0)));
+}
+inline Int min(Int a, Int b) { return select(lt(a, b), a, b); }
+inline Int max(Int a, Int b) { return select(lt(b, a), a, b); }
+#endif
+
+inline Mask mask_and(Mask a, Mask b) { return _mm_and_si128(a, b); }
+inline Mask mask_or(Mask a, Mask b) { return _mm_or_si128(a, b); }
+inline Mask mask_not(Mask a) { return _mm_xor_si128(a, _mm_set1_epi32(-1)); }
+inline unsigned mask_bits(Mask a) { return static_cast<unsigned>(_mm_movemask_ps(_mm_castsi128_ps(a))); }
+
+#elif GLOBAL_SIMD == GLOBAL_SIMD_NEON
+constexpr int WIDTH = 4;
+constexpr const char* NAME = "NEON";
+typedef float32x4_t Float;
+typedef int32x4_t Int;
+typedef uint32x4_t Mask;   // All bits of a lane set or clear
+
+inline Float load(const float* p) { return vld1q_f32(p); }
+inline void store(float* p, Float a) { vst1q_f32(p, a); }
+inline Float broadcast(float value) { return vdupq_n_f32(value); }
+inline Float add(Float a, Float b) { return vaddq_f32(a, b); }
+inline Float sub(Float a, Float b) { return vsubq_f32(a, b); }
+inline Float mul(Float a, Float b) { return vmulq_f32(a, b); }
+inline Float div(Float a, Float b) { return vdivq_f32(a, b); }
+inline Float min(Float a, Float b) { return vminq_f32(a, b); }
+inline Float max(Float a, Float b) { return vmaxq_f32(a, b); }
+inline Float sqrt(Float a) { return vsqrtq_f32(a); }
+inline Float fma(Float a, Float b, Float c) { return vfmaq_f32(c, a, b); }
+inline Mask eq(Float a, Float b) { return vceqq_f32(a, b); }
+inline Mask lt(Float a, Float b) { return vcltq_f32(a, b); }
+inline Mask le(Float a, Float b) { return vcleq_f32(a, b); }
+inline Float select(Mask m, Float a, Float b) { return vbslq_f32(m, a, b); }
+inline Int to_int(Float a) { return vcvtq_s32_f32(a); }
+inline Float to_float(Int a) { return vcvtq_f32_s32(a); }
+
+inline Int load(const std::int32_t* p) { return vld1q_s32(p); }
+inline void store(std::int32_t* p, Int a) { vst1q_s32(p, a); }
+inline Int broadcast(std::int32_t value) { return vdupq_n_s32(value); }
+inline Int add(Int a, Int b) { return vaddq_s32(a, b); }
+inline Int sub(Int a, Int b) { return vsubq_s32(a, b); }
+inline Int mul(Int a, Int b) { return vmulq_s32(a, b); }
+inline Int min(Int a, Int b) { return vminq_s32(a, b); }
+inline Int max(Int a, Int b) { return vmaxq_s32(a, b); }
+inline Int bit_and(Int a, Int b) { return vandq_s32(a, b); }
+inline Int bit_or(Int a, Int b) { return vorrq_s32(a, b); }
+inline Int bit_xor(Int a, Int b) { return veorq_s32(a, b); }
+inline Int shift_left(Int a, int bits) { return vshlq_s32(a, vdupq_n_s32(bits)); }
+inline Int shift_right(Int a, int bits) { return vshlq_s32(a, vdupq_n_s32(-bits)); }
+inline Mask eq(Int a, Int b) { return vceqq_s32(a, b); }
+inline Mask lt(Int a, Int b) { return vcltq_s32(a, b); }
+inline Int select(Mask m, Int a, Int b) { return vbslq_s32(m, a, b); }
+
+inline Mask mask_and(Mask a, Mask b) { return vandq_u32(a, b); }
+inline Mask mask_or(Mask a, Mask b) { return vorrq_u32(a, b); }
+inline Mask mask_not(Mask a) { return vmvnq_u32(a); }
+inline unsigned mask_bits(Mask a) {
+    const std::uint32_t weights[4] = { 1, 2, 4, 8 };
+    return vaddvq_u32(vandq_u32(a, vld1q_u32(weights)));
+}
+
+#else
+// Plain arrays, which the compiler may still vectorize
+constexpr int WIDTH = 4;
+constexpr const char* NAME = "scalar";
+struct Float { float lanes[4]; };
+struct Int { std::int32_t lanes[4]; };
+struct Mask { bool lanes[4]; };
+
+template <typename R, typename F>
+inline R each(F&& function) {
+    R result;
+    for (int i = 0; i < 4; i++) result.lanes[i] = function(i);
+    return result;
+}
+
+inline Float load(const float* p) { return each<Float>([p](int i) { return p[i]; }); }
+inline void store(float* p, Float a) { std::memcpy(p, a.lanes, sizeof(a.lanes)); }
+inline Float broadcast(float value) { return each<Float>([value](int) { return value; }); }
+inline Float add(Float a, Float b) { return each<Float>([&](int i) { return a.lanes[i] + b.lanes[i]; }); }
+inline Float sub(Float a, Float b) { return each<Float>([&](int i) { return a.lanes[i] - b.lanes[i]; }); }
+inline Float mul(Float a, Float b) { return each<Float>([&](int i) { return a.lanes[i] * b.lanes[i]; }); }
+inline Float div(Float a, Float b) { return each<Float>([&](int i) { return a.lanes[i] / b.lanes[i]; }); }
+inline Float min(Float a, Float b) { return each<Float>([&](int i) { return b.lanes[i] < a.lanes[i] ? b.lanes[i] : a.lanes[i]; }); }
+inline Float max(Float a, Float b) { return each<Float>([&](int i) { return a.lanes[i] < b.lanes[i] ? b.lanes[i] : a.lanes[i]; }); }
+inline Float sqrt(Float a) { return each<Float>([&](int i) { return std::sqrt(a.lanes[i]); }); }
+inline Float fma(Float a, Float b, Float c) { return each<Float>([&](int i) { return a.lanes[i] * b.lanes[i] + c.lanes[i]; }); }
+inline Mask eq(Float a, Float b) { return each<Mask>([&](int i) { return a.lanes[i] == b.lanes[i]; }); }
+inline Mask lt(Float a, Float b) { return each<Mask>([&](int i) { return a.lanes[i] < b.lanes[i]; }); }
+inline Mask le(Float a, Float b) { return each<Mask>([&](int i) { return a.lanes[i] <= b.lanes[i]; }); }
+inline Float select(Mask m, Float a, Float b) { return each<Float>([&](int i) { return m.lanes[i] ? a.lanes[i] : b.lanes[i]; }); }
+inline Int to_int(Float a) { return each<Int>([&](int i) { return static_cast<std::int32_t>(a.lanes[i]); }); }
+inline Float to_float(Int a) { return each<Float>([&](int i) { return static_cast<float>(a.lanes[i]); }); }
+
+// Wrapping like the SIMD instructions, through unsigned math
+inline std::int32_t wrap(std::uint32_t value) { return static_cast<std::int32_t>(value); }
+inline std::uint32_t bits_of(std::int32_t value) { return static_cast<std::uint32_t>(value); }
+
+inline Int load(const std::int32_t* p) { return each<Int>([p](int i) { return p[i]; }); }
+inline void store(std::int32_t* p, Int a) { std::memcpy(p, a.lanes, sizeof(a.lanes)); }
+inline Int broadcast(std::int32_t value) { return each<Int>([value](int) { return value; }); }
+inline Int add(Int a, Int b) { return each<Int>([&](int i) { return wrap(bits_of(a.lanes[i]) + bits_of(b.lanes[i])); }); }
+inline Int sub(Int a, Int b) { return each<Int>([&](int i) { return wrap(bits_of(a.lanes[i]) - bits_of(b.lanes[i])); }); }
+inline Int mul(Int a, Int b) { return each<Int>([&](int i) { return wrap(bits_of(a.lanes[i]) * bits_of(b.lanes[i])); }); }
+inline Int min(Int a, Int b) { return each<Int>([&](int i) { return std::min(a.lanes[i], b.lanes[i]); }); }
+inline Int max(Int a, Int b) { return each<Int>([&](int i) { return std::max(a.lanes[i], b.lanes[i]); }); }
+inline Int bit_and(Int a, Int b) { return each<Int>([&](int i) { return a.lanes[i] & b.lanes[i]; }); }
+inline Int bit_or(Int a, Int b) { return each<Int>([&](int i) { return a.lanes[i] | b.lanes[i]; }); }
+inline Int bit_xor(Int a, Int b) { return each<Int>([&](int i) { return a.lanes[i] ^ b.lanes[i]; }); }
+inline Int shift_left(Int a, int bits) { return each<Int>([&](int i) { return wrap(bits_of(a.lanes[i]) << bits); }); }
+inline Int shift_right(Int a, int bits) { return each<Int>([&](int i) { return a.lanes[i] >> bits; }); }
+inline Mask eq(Int a, Int b) { return each<Mask>([&](int i) { return a.lanes[i] == b.lanes[i]; }); }
+inline Mask lt(Int a, Int b) { return each<Mask>([&](int i) { return a.lanes[i] < b.lanes[i]; }); }
+inline Int select(Mask m, Int a, Int b) { return each<Int>([&](int i) { return m.lanes[i] ? a.lanes[i] : b.lanes[i]; }); }
+
+inline Mask mask_and(Mask a, Mask b) { return each<Mask>([&](int i) { return a.lanes[i] && b.lanes[i]; }); }
+inline Mask mask_or(Mask a, Mask b) { return each<Mask>([&](int i) { return a.lanes[i] || b.lanes[i]; }); }
+inline Mask mask_not(Mask a) { return each<Mask>([&](int i) { return !a.lanes[i]; }); }
+inline unsigned mask_bits(Mask a) {
+    unsigned bits = 0;
+    for (int i = 0; i < 4; i++) bits |= static_cast<unsigned>(a.lanes[i]) << i;
+    return bits;
+}
+#endif
+
+#if GLOBAL_SIMD != GLOBAL_SIMD_AVX512 && GLOBAL_SIMD != GLOBAL_SIMD_AVX2
+// No gather instruction, one lane at a time
+template <typename T, typename Vector>
+inline Vector gather_lanes(const T* base, Int indices) {
+    alignas(64) std::int32_t offsets[WIDTH];
+    alignas(64) T values[WIDTH];
+    store(offsets, indices);
+    for (int i = 0; i < WIDTH; i++) values[i] = base[offsets[i]];
+    return load(values);
+}
+inline Float gather(const float* base, Int indices) { return gather_lanes<float, Float>(base, indices); }
+inline Int gather(const std::int32_t* base, Int indices) { return gather_lanes<std::int32_t, Int>(base, indices); }
+#endif
+}
+
+// Loads count < WIDTH values, the rest are 0
+template <typename T>
+inline auto load_partial(const T* p, std::size_t count) {
+    alignas(64) T values[simd::WIDTH] = {};
+    std::memcpy(values, p, std::min<std::size_t>(count, simd::WIDTH) * sizeof(T));
+    return simd::load(values);
+}
+
+template <typename T, typename Vector>
+inline void store_partial(T* p, std::size_t count, Vector a) {
+    alignas(64) T values[simd::WIDTH];
+    simd::store(values, a);
+    std::memcpy(p, values, std::min<std::size_t>(count, simd::WIDTH) * sizeof(T));
+}
+
+template <typename T, typename Vector, typename F>
+inline T reduce_lanes(Vector a, F&& function) {
+    alignas(64) T values[simd::WIDTH];
+    simd::store(values, a);
+    T result = values[0];
+    for (int i = 1; i < simd::WIDTH; i++) result = function(result, values[i]);
+    return result;
+}
+}
+
+inline constexpr const char* SIMD_BACKEND = global_detail::simd::NAME;
+
+// The result of comparing SimdFloats or SimdInts, one bool per lane
+struct SimdMask {
+    global_detail::simd::Mask native;
+
+    // Bit i is lane i
+    unsigned bits() const { return global_detail::simd::mask_bits(native); }
+    bool any() const { return bits() != 0; }
+    bool all() const { return bits() == (1U << global_detail::simd::WIDTH) - 1; }
+
+    friend SimdMask operator&(SimdMask a, SimdMask b) { return { global_detail::simd::mask_and(a.native, b.native) }; }
+    friend SimdMask operator|(SimdMask a, SimdMask b) { return { global_detail::simd::mask_or(a.native, b.native) }; }
+    friend SimdMask operator!(SimdMask a) { return { global_detail::simd::mask_not(a.native) }; }
+};
+
+struct SimdInt {
+    static constexpr int size = global_detail::simd::WIDTH;
+    global_detail::simd::Int native;
+
+    SimdInt() = default;   // Uninitialized
+    SimdInt(std::int32_t value) : native(global_detail::simd::broadcast(value)) {}
+    explicit SimdInt(global_detail::simd::Int value) : native(value) {}
+
+    // load(p, count) and store(p, count) are for the last count < size values
+    static SimdInt load(const std::int32_t* p) { return SimdInt(global_detail::simd::load(p)); }
+    static SimdInt load(const std::int32_t* p, std::size_t count) {
+        return count >= static_cast<std::size_t>(size) ? load(p) : SimdInt(global_detail::load_partial(p, count));
+    }
+    void store(std::int32_t* p) const { global_detail::simd::store(p, native); }
+    void store(std::int32_t* p, std::size_t count) const {
+        if (count >= static_cast<std::size_t>(size)) store(p);
+        else global_detail::store_partial(p, count, native);
+    }
+    // base[indices[i]] for every lane
+    static SimdInt gather(const std::int32_t* base, SimdInt indices) { return SimdInt(global_detail::simd::gather(base, indices.native)); }
+
+    friend SimdInt operator+(SimdInt a, SimdInt b) { return SimdInt(global_detail::simd::add(a.native, b.native)); }
+    friend SimdInt operator-(SimdInt a, SimdInt b) { return SimdInt(global_detail::simd::sub(a.native, b.native)); }
+    friend SimdInt operator*(SimdInt a, SimdInt b) { return SimdInt(global_detail::simd::mul(a.native, b.native)); }
+    friend SimdInt operator&(SimdInt a, SimdInt b) { return SimdInt(global_detail::simd::bit_and(a.native, b.native)); }
+    friend SimdInt operator|(SimdInt a, SimdInt b) { return SimdInt(global_detail::simd::bit_or(a.native, b.native)); }
+    friend SimdInt operator^(SimdInt a, SimdInt b) { return SimdInt(global_detail::simd::bit_xor(a.native, b.native)); }
+    friend SimdInt operator<<(SimdInt a, int bits) { return SimdInt(global_detail::simd::shift_left(a.native, bits)); }
+    friend SimdInt operator>>(SimdInt a, int bits) { return SimdInt(global_detail::simd::shift_right(a.native, bits)); }
+    friend SimdInt operator-(SimdInt a) { return SimdInt(0) - a; }
+    SimdInt& operator+=(SimdInt other) { return *this = *this + other; }
+    SimdInt& operator-=(SimdInt other) { return *this = *this - other; }
+    SimdInt& operator*=(SimdInt other) { return *this = *this * other; }
+
+    friend SimdMask operator==(SimdInt a, SimdInt b) { return { global_detail::simd::eq(a.native, b.native) }; }
+    friend SimdMask operator!=(SimdInt a, SimdInt b) { return !(a == b); }
+    friend SimdMask operator<(SimdInt a, SimdInt b) { return { global_detail::simd::lt(a.native, b.native) }; }
+    friend SimdMask operator>(SimdInt a, SimdInt b) { return b < a; }
+    friend SimdMask operator<=(SimdInt a, SimdInt b) { return !(b < a); }
+    friend SimdMask operator>=(SimdInt a, SimdInt b) { return !(a < b); }
+
+    friend SimdInt min(SimdInt a, SimdInt b) { return SimdInt(global_detail::simd::min(a.native, b.native)); }
+    friend SimdInt max(SimdInt a, SimdInt b) { return SimdInt(global_detail::simd::max(a.native, b.native)); }
+    // a where mask is set, b elsewhere
+    friend SimdInt select(SimdMask mask, SimdInt a, SimdInt b) { return SimdInt(global_detail::simd::select(mask.native, a.native, b.native)); }
+
+    // Wraps around on overflow, like the lanes do
+    friend std::int32_t reduce_add(SimdInt a) {
+        return global_detail::reduce_lanes<std::int32_t>(a.native, [](std::int32_t x, std::int32_t y) {
+            return static_cast<std::int32_t>(static_cast<std::uint32_t>(x) + static_cast<std::uint32_t>(y));
+        });
+    }
+    friend std::int32_t reduce_min(SimdInt a) { return global_detail::reduce_lanes<std::int32_t>(a.native, [](std::int32_t x, std::int32_t y) { return std::min(x, y); }); }
+    friend std::int32_t reduce_max(SimdInt a) { return global_detail::reduce_lanes<std::int32_t>(a.native, [](std::int32_t x, std::int32_t y) { return std::max(x, y); }); }
+};
+
+struct SimdFloat {
+    static constexpr int size = global_detail::simd::WIDTH;
+    global_detail::simd::Float native;
+
+    SimdFloat() = default;   // Uninitialized
+    SimdFloat(float value) : native(global_detail::simd::broadcast(value)) {}
+    explicit SimdFloat(global_detail::simd::Float value) : native(value) {}
+
+    // load(p, count) and store(p, count) are for the last count < size values
+    static SimdFloat load(const float* p) { return SimdFloat(global_detail::simd::load(p)); }
+    static SimdFloat load(const float* p, std::size_t count) {
+        return count >= static_cast<std::size_t>(size) ? load(p) : SimdFloat(global_detail::load_partial(p, count));
+    }
+    void store(float* p) const { global_detail::simd::store(p, native); }
+    void store(float* p, std::size_t count) const {
+        if (count >= static_cast<std::size_t>(size)) store(p);
+        else global_detail::store_partial(p, count, native);
+    }
+    // base[indices[i]] for every lane
+    static SimdFloat gather(const float* base, SimdInt indices) { return SimdFloat(global_detail::simd::gather(base, indices.native)); }
+
+    friend SimdFloat operator+(SimdFloat a, SimdFloat b) { return SimdFloat(global_detail::simd::add(a.native, b.native)); }
+    friend SimdFloat operator-(SimdFloat a, SimdFloat b) { return SimdFloat(global_detail::simd::sub(a.native, b.native)); }
+    friend SimdFloat operator*(SimdFloat a, SimdFloat b) { return SimdFloat(global_detail::simd::mul(a.native, b.native)); }
+    friend SimdFloat operator/(SimdFloat a, SimdFloat b) { return SimdFloat(global_detail::simd::div(a.native, b.native)); }
+    friend SimdFloat operator-(SimdFloat a) { return SimdFloat(-0.0f) - a; }
+    SimdFloat& operator+=(SimdFloat other) { return *this = *this + other; }
+    SimdFloat& operator-=(SimdFloat other) { return *this = *this - other; }
+    SimdFloat& operator*=(SimdFloat other) { return *this = *this * other; }
+    SimdFloat& operator/=(SimdFloat other) { return *this = *this / other; }
+
+    // Comparisons with NaN are false, except !=
+    friend SimdMask operator==(SimdFloat a, SimdFloat b) { return { global_detail::simd::eq(a.native, b.native) }; }
+    friend SimdMask operator!=(SimdFloat a, SimdFloat b) { return !(a == b); }
+    friend SimdMask operator<(SimdFloat a, SimdFloat b) { return { global_detail::simd::lt(a.native, b.native) }; }
+    friend SimdMask operator>(SimdFloat a, SimdFloat b) { return b < a; }
+    friend SimdMask operator<=(SimdFloat a, SimdFloat b) { return { global_detail::simd::le(a.native, b.native) }; }
+    friend SimdMask operator>=(SimdFloat a, SimdFloat b) { return b <= a; }
+
+    friend SimdFloat min(SimdFloat a, SimdFloat b) { return SimdFloat(global_detail::simd::min(a.native, b.native)); }
+    friend SimdFloat max(SimdFloat a, SimdFloat b) { return SimdFloat(global_detail::simd::max(a.native, b.native)); }
+    friend SimdFloat sqrt(SimdFloat a) { return SimdFloat(global_detail::simd::sqrt(a.native)); }
+    // a * b + c, in one rounding if the CPU has FMA
+    friend SimdFloat fma(SimdFloat a, SimdFloat b, SimdFloat c) { return SimdFloat(global_detail::simd::fma(a.native, b.native, c.native)); }
+    // a where mask is set, b elsewhere
+    friend SimdFloat select(SimdMask mask, SimdFloat a, SimdFloat b) { return SimdFloat(global_detail::simd::select(mask.native, a.native, b.native)); }
+
+    friend float reduce_add(SimdFloat a) { return global_detail::reduce_lanes<float>(a.native, [](float x, float y) { return x + y; }); }
+    friend float reduce_min(SimdFloat a) { return global_detail::reduce_lanes<float>(a.native, [](float x, float y) { return y < x ? y : x; }); }
+    friend float reduce_max(SimdFloat a) { return global_detail::reduce_lanes<float>(a.native, [](float x, float y) { return x < y ? y : x; }); }
+
+    // Rounded toward zero, the values have to fit in an int32
+    friend SimdInt to_int(SimdFloat a) { return SimdInt(global_detail::simd::to_int(a.native)); }
+};
+
+static inline SimdFloat to_float(SimdInt a) { return SimdFloat(global_detail::simd::to_float(a.native)); }
+#pragma GCC diagnostic pop
+#ifdef __clang__
+#pragma GCC diagnostic pop
+#endif // "-Wc++98-compat" (simd: constexpr, lambdas)
@@ -0,0 +1,324 @@
+#pragma once
+#include <charconv>
+#include <cstddef>
+#include <cstring>
+#include <ctime>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include "platform.hpp"
+#include "types.hpp"
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wunused-function"
+#ifdef __clang__
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wc++98-compat"
+#pragma GCC diagnostic ignored "-Wunused-template"
+#endif
+// If string is equal to ANY of the others
+template <typename... Args>
+static inline bool streq(std::string_view str, Args&&... args) { return ((str == std::string_view(args)) || ...); }
+
+namespace global_detail {
+inline bool is_space(char c) { return c == ' ' || (c >= '\t' && c <= '\r'); }
+}
+
+// Removes whitespace from both ends, as a view into str, without allocating
+static inline std::string_view trim_view(std::string_view str) {
+    std::size_t begin = 0, end = str.size();
+    while (begin < end && global_detail::is_space(str[begin])) begin++;
+    while (end > begin && global_detail::is_space(str[end - 1])) end--;
+    return str.substr(begin, end - begin);
+}
+
+// Removes whitespace from both ends, as a std::string. A temporary one is trimmed in place and moved
+// out, otherwise only the trimmed part is copied: use trim_view() to not allocate at all.
+static inline std::string trim(std::string&& str) {
+    std::string_view view = trim_view(str);
+    std::size_t begin = static_cast<std::size_t>(view.data() - str.data());
+    str.erase(begin + view.size());
+    str.erase(0, begin);
+    return std::move(str);
+}
+static inline std::string trim(std::string_view str) { return std::string(trim_view(str)); }
+static inline std::string trim(const std::string& str) { return std::string(trim_view(str)); }
+static inline std::string trim(const char* str) { return std::string(trim_view(str)); }
+
+static std::string timestr(const std::time_t& time = std::time(nullptr), const char* const format = "%Y-%m-%d %H:%M:%S") {
+    #ifdef _WIN32
+    std::tm tb;
+    localtime_s(&tb, &time);
+    char mbstr[64];
+    std::strftime(mbstr, sizeof(mbstr), format, &tb);
+    #else
+    std::tm *tb;
+    tb = localtime(&time);
+    char mbstr[64];
+    std::strftime(mbstr, sizeof(mbstr), format, tb);
+    #endif
+    return std::string(mbstr);
+}
+
+// Searching, splitting and parsing on std::string_view, none of them allocate.
+// strcount() and strfind() compare 16 or 32 characters at a time with SSE2, AVX2 or NEON.
+namespace global_detail {
+inline char to_lower(char c) { return c >= 'A' && c <= 'Z' ? static_cast<char>(c - 'A' + 'a') : c; }
+
+inline unsigned lowest_bit(unsigned mask) {
+    #ifdef _MSC_VER
+    unsigned long index;
+    _BitScanForward(&index, mask);
+    return static_cast<unsigned>(index);
+    #else
+    return static_cast<unsigned>(__builtin_ctz(mask));
+    #endif
+}
+}
+
+// Compares ASCII letters without case: < 0, 0 or > 0 like strcmp
+static inline int strcmp_nocase(std::string_view a, std::string_view b) {
+    std::size_t size = std::min(a.size(), b.size());
+    for (std::size_t i = 0; i < size; i++) {
+        char x = global_detail::to_lower(a[i]), y = global_detail::to_lower(b[i]);
+        if (x != y) return static_cast<unsigned char>(x) < static_cast<unsigned char>(y) ? -1 : 1;
+    }
+    return a.size() < b.size() ? -1 : (a.size() > b.size() ? 1 : 0);
+}
+
+// If string is equal to ANY of the others, without case
+template <typename... Args>
+static inline bool streq_nocase(std::string_view str, Args&&... args) {
+    return ((str.size() == std::string_view(args).size() && strcmp_nocase(str, args) == 0) || ...);
+}
+
+// How many times c is in text
+static inline std::size_t strcount(std::string_view text, char c) {
+    const char* data = text.data();
+    std::size_t size = text.size(), i = 0, count = 0;
+    #if defined(__AVX2__)
+    // Matches are -1 per byte, subtracted into byte counters, which are added up before 255 blocks overflow them
+    const __m256i target = _mm256_set1_epi8(c);
+    while (i + 32 <= size) {
+        __m256i counters = _mm256_setzero_si256();
+        for (std::size_t end = std::min(size - 31, i + 255 * 32); i < end; i += 32) {
+            __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+            counters = _mm256_sub_epi8(counters, _mm256_cmpeq_epi8(block, target));
+        }
+        __m256i sums = _mm256_sad_epu8(counters, _mm256_setzero_si256());
+        alignas(32) u64 lanes[4];
+        _mm256_store_si256(reinterpret_cast<__m256i*>(lanes), sums);
+        count += lanes[0] + lanes[1] + lanes[2] + lanes[3];
+    }
+    #elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+    const __m128i target = _mm_set1_epi8(c);
+    while (i + 16 <= size) {
+        __m128i counters = _mm_setzero_si128();
+        for (std::size_t end = std::min(size - 15, i + 255 * 16); i < end; i += 16) {
+            __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+            counters = _mm_sub_epi8(counters, _mm_cmpeq_epi8(block, target));
+        }
+        __m128i sums = _mm_sad_epu8(counters, _mm_setzero_si128());
+        alignas(16) u64 lanes[2];
+        _mm_store_si128(reinterpret_cast<__m128i*>(lanes), sums);
+        count += lanes[0] + lanes[1];
+    }
+    #elif defined(__ARM_NEON) && defined(__aarch64__)
+    const uint8x16_t target = vdupq_n_u8(static_cast<std::uint8_t>(c));
+    while (i + 16 <= size) {
+        uint8x16_t counters = vdupq_n_u8(0);
+        for (std::size_t end = std::min(size - 15, i + 255 * 16); i < end; i += 16) {
+            uint8x16_t block = vld1q_u8(reinterpret_cast<const std::uint8_t*>(data + i));
+            counters = vsubq_u8(counters, vceqq_u8(block, target));
+        }
+        count += vaddlvq_u8(counters);
+    }
+    #endif
+    for (; i < size; i++) count += data[i] == c;
+    return count;
+}
+
+// Where c is first found in text from position from, or npos
+static inline std::size_t strfind(std::string_view text, char c, std::size_t from = 0) {
+    return text.find(c, from);   // memchr, which every C library does with SIMD already
+}
+
+// Where needle is first found in text from position from, or npos. Candidates are positions where
+// both the first and last characters match, checked a block at a time, so repetitive text stays fast.
+static inline std::size_t strfind(std::string_view text, std::string_view needle, std::size_t from = 0) {
+    if (needle.size() <= 1) return needle.empty() ? text.find(needle, from) : text.find(needle[0], from);
+    std::size_t i = from;
+    #if defined(__AVX2__) || defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+    const char* data = text.data();
+    std::size_t size = text.size(), last = needle.size() - 1;
+    #endif
+    #if defined(__AVX2__)
+    const __m256i first_char = _mm256_set1_epi8(needle[0]), last_char = _mm256_set1_epi8(needle[last]);
+    for (; i + last + 32 <= size; i += 32) {
+        __m256i first_block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+        __m256i last_block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i + last));
+        __m256i matches = _mm256_and_si256(_mm256_cmpeq_epi8(first_block, first_char), _mm256_cmpeq_epi8(last_block, last_char));
+        for (unsigned mask = static_cast<unsigned>(_mm256_movemask_epi8(matches)); mask != 0; mask &= mask - 1) {
+            std::size_t position = i + global_detail::lowest_bit(mask);
+            if (std::memcmp(data + position + 1, needle.data() + 1, last - 1) == 0) return position;
+        }
+    }
+    #elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+    const __m128i first_char = _mm_set1_epi8(needle[0]), last_char = _mm_set1_epi8(needle[last]);
+    for (; i + last + 16 <= size; i += 16) {
+        __m128i first_block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+        __m128i last_block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i + last));
+        __m128i matches = _mm_and_si128(_mm_cmpeq_epi8(first_block, first_char), _mm_cmpeq_epi8(last_block, last_char));
+        for (unsigned mask = static_cast<unsigned>(_mm_movemask_epi8(matches)); mask != 0; mask &= mask - 1) {
+            std::size_t position = i + global_detail::lowest_bit(mask);
+            if (std::memcmp(data + position + 1, needle.data() + 1, last - 1) == 0) return position;
+        }
+    }
+    #endif
+    return text.find(needle, i);
+}
+
+// How many times needle is in text, without overlapping
+static inline std::size_t strcount(std::string_view text, std::string_view needle) {
+    if (needle.size() == 1) return strcount(text, needle[0]);
+    if (needle.empty()) return 0;
+    std::size_t count = 0;
+    for (std::size_t i = strfind(text, needle); i != std::string_view::npos; i = strfind(text, needle, i + needle.size())) count++;
+    return count;
+}
+
+// The parts of text between delimiters, empty ones too: "a,,b" is "a", "", "b".
+// Without a delimiter it splits on whitespace and skips empty parts, like Python's split().
+// The parts point into text: for (std::string_view field : split(line, ','))
+class SplitIterator {
+public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = std::string_view;
+    using difference_type = std::ptrdiff_t;
+    using pointer = const std::string_view*;
+    using reference = const std::string_view&;
+
+    enum { SPLIT_WHITESPACE, SPLIT_CHAR, SPLIT_STRING };
+
+    SplitIterator() = default;
+    SplitIterator(std::string_view text, int mode, char single, std::string_view separator)
+        : rest(text), delimiter(separator), delimiter_char(single), split_mode(mode), valid(true) {
+        if (split_mode == SPLIT_WHITESPACE) skip_spaces();
+        advance();
+    }
+
+    reference operator*() const { return part; }
+    pointer operator->() const { return &part; }
+    SplitIterator& operator++() {
+        advance();
+        return *this;
+    }
+    SplitIterator operator++(int) {
+        SplitIterator copy = *this;
+        advance();
+        return copy;
+    }
+    bool operator==(const SplitIterator& other) const { return valid == other.valid && (!valid || part.data() == other.part.data()); }
+    bool operator!=(const SplitIterator& other) const { return !(*this == other); }
+
+private:
+    std::string_view rest;
+    std::string_view delimiter;
+    std::string_view part;
+    char delimiter_char = '\0';
+    int split_mode = SPLIT_WHITESPACE;
+    bool last = false;   // The last part has been found
+    bool valid = false;  // False at the end
+
+    void skip_spaces() {
+        std::size_t begin = 0;
+        while (begin < rest.size() && global_detail::is_space(rest[begin])) begin++;
+        rest.remove_prefix(begin);
+    }
+
+    void advance() {
+        if (split_mode == SPLIT_WHITESPACE) {
+            if (rest.empty()) {
+                valid = false;
+                return;
+            }
+            std::size_t end = 0;
+            while (end < rest.size() && !global_detail::is_space(rest[end])) end++;
+            part = rest.substr(0, end);
+            rest.remove_prefix(end);
+            skip_spaces();
+            return;
+        }
+        if (last) {
+            valid = false;
+            return;
+        }
+        std::size_t end = split_mode == SPLIT_CHAR ? strfind(rest, delimiter_char) : strfind(rest, delimiter);
+        if (end == std::string_view::npos) {
+            part = rest;
+            last = true;
+            return;
+        }
+        part = rest.substr(0, end);
+        rest.remove_prefix(end + (split_mode == SPLIT_CHAR ? 1 : delimiter.size()));
+    }
+};
+
+struct SplitRange {
+    std::string_view text;
+    int mode;
+    char single;
+    std::string_view separator;
+    SplitIterator begin() const { return SplitIterator(text, mode, single, separator); }
+    SplitIterator end() const { return SplitIterator(); }
+};
+
+static inline SplitRange split(std::string_view text, char delimiter) {
+    return SplitRange{ text, SplitIterator::SPLIT_CHAR, delimiter, std::string_view() };
+}
+static inline SplitRange split(std::string_view text, std::string_view delimiter) {
+    if (delimiter.empty()) return SplitRange{ text, SplitIterator::SPLIT_WHITESPACE, '\0', delimiter };
+    return SplitRange{ text, SplitIterator::SPLIT_STRING, '\0', delimiter };
+}
+static inline SplitRange split(std::string_view text) {
+    return SplitRange{ text, SplitIterator::SPLIT_WHITESPACE, '\0', std::string_view() };
+}
+
+// Parses all of text as a number, with from_chars: no whitespace, locale or allocation.
+// A leading '+' is allowed. value is only changed if it succeeds: if (!parse(field, count)) ...
+template <typename T>
+static bool parse(std::string_view text, T& value) {
+    static_assert(std::is_arithmetic_v<T> && !std::is_same_v<T, bool>, "parse() takes a number");
+    if (!text.empty() && text[0] == '+') {
+        text.remove_prefix(1);
+        if (!text.empty() && text[0] == '-') return false;
+    }
+    if (text.empty()) return false;
+    T result{};
+    const char* end = text.data() + text.size();
+    if constexpr (std::is_integral_v<T>) {
+        std::from_chars_result parsed = std::from_chars(text.data(), end, result);
+        if (parsed.ec != std::errc() || parsed.ptr != end) return false;
+    }
+    else {
+        #if defined(__cpp_lib_to_chars) || defined(_MSC_VER)
+        std::from_chars_result parsed = std::from_chars(text.data(), end, result);
+        if (parsed.ec != std::errc() || parsed.ptr != end) return false;
+        #else
+        char str[128];
+        if (text.size() >= sizeof(str) || global_detail::is_space(text[0])) return false;
+        std::memcpy(str, text.data(), text.size());
+        str[text.size()] = '\0';
+        char* parsed;
+        errno = 0;
+        result = static_cast<T>(std::strtold(str, &parsed));
+        if (errno != 0 || parsed != str + text.size()) return false;
+        #endif
+    }
+    value = result;
+    return true;
+}
+#ifdef __clang__
+#pragma GCC diagnostic pop
+#endif // "-Wc++98-compat" (strings: auto, nullptr)
+#pragma GCC diagnostic pop
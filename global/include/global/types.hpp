@@ -0,0 +1,28 @@
+#pragma once
+#include <cstdlib>
+
+
+typedef unsigned char u8;
+typedef unsigned short u16;
+typedef unsigned long u32;
+typedef char s8;
+typedef short s16;
+typedef long s32;
+typedef float f32;
+typedef double f64;
+#ifdef __clang__
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wc++98-compat-pedantic"
+#endif
+typedef unsigned long long u64;
+typedef long long s64;
+#ifdef __clang__
+#pragma GCC diagnostic pop
+#endif
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wunused-macros"
+#define alloc(num, type) static_cast<type*>(malloc(sizeof(type)*num))
+#define arrlen(array) (sizeof(array)/sizeof(array[0]))
+#define putline(scanner, line) scanner << line << "\n"
+#pragma GCC diagnostic pop
@@ -0,0 +1,6 @@
+#pragma once
+#include <string>
+#include <vector>
+
+using std::string;
+using std::vector;
@@ -1,16 +1,43 @@
 #include <algorithm>
+#include <cctype>
+#include <cerrno>
 #include <cstdlib>
 #include <cstdio>
 #include <ctime>
 #include <chrono>
+#include <condition_variable>
+#include <cmath>
+#include <cstdint>
 #include <filesystem>
 #include <fstream>
+#include <iomanip>
 #include <iostream>
+#include <map>
+#include <mutex>
 #include <regex>
 #include <string>
 #include <sstream>
+#include <thread>
 #include <vector>
 
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#include <process.h>
+#else
+#include <fcntl.h>
+#include <netdb.h>
+#include <signal.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+#ifdef __linux__
+#include <sched.h>
+#endif
+
 using std::string;
 namespace fs = std::filesystem;
 
@@ -60,22 +87,24 @@ flags = "-march=native"
 compiler = ")" + DEFAULT_COMPILER + "\"\n" +
 R"(optimization = ""
 flags = "-g"
+linker = "auto"
 )";
 
 static const string DEFAULT_PROGRAM =
 R"(#include <iostream>
 #include <random>
 
+// std::cout is flushed at exit, so there's no need to flush every line
 template<typename... Args>
 static inline void print(Args&&... args) {
-    (std::cout << ... << std::forward<Args>(args)) << std::flush;
+    (std::cout << ... << std::forward<Args>(args));
 }
 
 template <typename Arg, typename... Args>
 static inline void printl(Arg&& arg, Args&&... args) {
     std::cout << std::forward<Arg>(arg);
     ((std::cout << ' ' << std::forward<Args>(args)), ...);
-    std::cout << std::endl;
+    std::cout << '\n';
 }
 
 static int rng(int lower_bound, int upper_bound) {
@@ -101,6 +130,500 @@ static const string DEFAULT_GITIGNORE_EMPTY =
 R"(# Don't ignore this file
 !.gitignore)";
 
+// Linked into "zmake profile" builds when perf doesn't work. It samples the call stack with backtrace()
+// on SIGPROF, i.e. every 1/ZMAKE_SAMPLER_HZ seconds of CPU time, and writes the stacks folded to
+// ZMAKE_SAMPLER_OUTPUT at exit. Frames without a symbol are written as 0xOFFSET@module for addr2line.
+static const string SAMPLER_PROGRAM =
+R"(//// This file was automatically generated by zmake profile.
+#if defined(__clang__)
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Weverything"
+#elif defined(__GNUC__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpedantic"
+#pragma GCC diagnostic ignored "-Wconversion"
+#pragma GCC diagnostic ignored "-Wsign-conversion"
+#pragma GCC diagnostic ignored "-Wold-style-cast"
+#pragma GCC diagnostic ignored "-Wuseless-cast"
+#endif
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <string>
+#include <cxxabi.h>
+#include <dlfcn.h>
+#include <execinfo.h>
+#include <signal.h>
+#include <sys/time.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <link.h>
+#endif
+
+namespace zmake_sampler {
+
+static const int max_depth = 64;
+static const unsigned long max_samples = 1UL << 16;
+static void** frames = nullptr;     // max_depth frames per sample
+static int* depths = nullptr;
+static std::atomic<unsigned long> taken(0);
+static char output[4096];
+static pid_t owner = 0;
+
+static void on_sample(int, siginfo_t*, void*) {
+    int saved_errno = errno;
+    unsigned long i = taken.fetch_add(1, std::memory_order_relaxed);
+    if (i < max_samples) depths[i] = backtrace(frames + i * max_depth, max_depth);
+    errno = saved_errno;
+}
+
+__attribute__((constructor)) static void start() {
+    const char* path = std::getenv("ZMAKE_SAMPLER_OUTPUT");
+    if (path == nullptr || std::strlen(path) >= sizeof(output)) return;
+    std::strcpy(output, path);
+    // Programs this one starts shouldn't write over our samples
+    unsetenv("ZMAKE_SAMPLER_OUTPUT");
+    double hz = 997.0;
+    const char* hz_str = std::getenv("ZMAKE_SAMPLER_HZ");
+    if (hz_str != nullptr && std::atof(hz_str) >= 1.0) hz = std::atof(hz_str);
+
+    frames = static_cast<void**>(std::calloc(max_samples * max_depth, sizeof(void*)));
+    depths = static_cast<int*>(std::calloc(max_samples, sizeof(int)));
+    if (frames == nullptr || depths == nullptr) return;
+    owner = getpid();
+    // The first backtrace() loads libgcc, which mustn't happen in the signal handler
+    void* warmup[4];
+    backtrace(warmup, 4);
+
+    struct sigaction action;
+    std::memset(&action, 0, sizeof(action));
+    action.sa_sigaction = on_sample;
+    action.sa_flags = SA_SIGINFO | SA_RESTART;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGPROF, &action, nullptr);
+    struct itimerval timer;
+    timer.it_interval.tv_sec = 0;
+    timer.it_interval.tv_usec = static_cast<suseconds_t>(1000000.0 / hz);
+    if (timer.it_interval.tv_usec < 1) timer.it_interval.tv_usec = 1;
+    timer.it_value = timer.it_interval;
+    setitimer(ITIMER_PROF, &timer, nullptr);
+}
+
+static std::string frame_name(void* address) {
+    Dl_info info;
+    std::memset(&info, 0, sizeof(info));
+    #ifdef __linux__
+    struct link_map* map = nullptr;
+    if (dladdr1(address, &info, reinterpret_cast<void**>(&map), RTLD_DL_LINKMAP) == 0) return "[unknown]";
+    std::uintptr_t base = map != nullptr ? map->l_addr : reinterpret_cast<std::uintptr_t>(info.dli_fbase);
+    #else
+    if (dladdr(address, &info) == 0) return "[unknown]";
+    std::uintptr_t base = reinterpret_cast<std::uintptr_t>(info.dli_fbase);
+    #endif
+    if (info.dli_sname != nullptr) {
+        int status = 0;
+        char* demangled = abi::__cxa_demangle(info.dli_sname, nullptr, nullptr, &status);
+        std::string name = status == 0 && demangled != nullptr ? demangled : info.dli_sname;
+        std::free(demangled);
+        return name;
+    }
+    char offset[32];
+    std::snprintf(offset, sizeof(offset), "0x%llx@", static_cast<unsigned long long>(reinterpret_cast<std::uintptr_t>(address) - base));
+    return offset + std::string(info.dli_fname != nullptr ? info.dli_fname : "");
+}
+
+__attribute__((destructor)) static void stop() {
+    if (frames == nullptr || owner != getpid()) return;
+    struct itimerval timer;
+    std::memset(&timer, 0, sizeof(timer));
+    setitimer(ITIMER_PROF, &timer, nullptr);
+    signal(SIGPROF, SIG_IGN);
+
+    unsigned long count = taken.load();
+    unsigned long dropped = count > max_samples ? count - max_samples : 0;
+    if (count > max_samples) count = max_samples;
+    // The first two frames are on_sample() and the signal trampoline, the third is where it was
+    // interrupted and the rest are return addresses, so those are moved back into the call.
+    std::map<void*, std::string> names;
+    std::map<std::string, unsigned long> stacks;
+    for (unsigned long i = 0; i < count; i++) {
+        std::string stack = "";
+        for (int j = depths[i] - 1; j >= 2; j--) {
+            void* address = frames[i * max_depth + j];
+            if (j != 2) address = static_cast<char*>(address) - 1;
+            auto name = names.find(address);
+            if (name == names.end()) name = names.emplace(address, frame_name(address)).first;
+            if (!stack.empty()) stack += ";";
+            stack += name->second;
+        }
+        if (!stack.empty()) stacks[stack]++;
+    }
+
+    FILE* file = std::fopen(output, "w");
+    if (file == nullptr) return;
+    std::fprintf(file, "# dropped %lu\n", dropped);
+    for (const auto& stack: stacks) std::fprintf(file, "%s %lu\n", stack.first.c_str(), stack.second);
+    std::fclose(file);
+}
+
+}
+
+#if defined(__clang__)
+#pragma clang diagnostic pop
+#elif defined(__GNUC__)
+#pragma GCC diagnostic pop
+#endif
+)";
+
+// Linked into builds with -allocstats or alloc = "true". It counts every operator new and, with glibc,
+// every malloc (by interposing it and calling glibc's own), and reports at exit to stderr, or appends
+// to ZMAKE_ALLOC_REPORT. Threads count on their own and call sites go in a fixed lock-free table,
+// so it's cheap enough to leave on.
+static const string ALLOC_PROGRAM =
+R"(//// This file was automatically generated by zmake for -allocstats.
+#if defined(__clang__)
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Weverything"
+#elif defined(__GNUC__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpedantic"
+#pragma GCC diagnostic ignored "-Wconversion"
+#pragma GCC diagnostic ignored "-Wsign-conversion"
+#pragma GCC diagnostic ignored "-Wold-style-cast"
+#pragma GCC diagnostic ignored "-Wuseless-cast"
+#endif
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <cxxabi.h>
+#include <dlfcn.h>
+#include <unistd.h>
+#ifdef __APPLE__
+#include <malloc/malloc.h>
+#else
+#include <malloc.h>
+#endif
+
+#if defined(__GLIBC__)
+extern "C" {
+void* __libc_malloc(std::size_t size);
+void* __libc_calloc(std::size_t count, std::size_t size);
+void* __libc_realloc(void* ptr, std::size_t size);
+void* __libc_memalign(std::size_t alignment, std::size_t size);
+void __libc_free(void* ptr);
+}
+#endif
+
+namespace zmake_alloc {
+
+struct Site {
+    std::atomic<std::uintptr_t> address;
+    std::atomic<std::uint64_t> count;
+    std::atomic<std::uint64_t> bytes;
+};
+
+static const std::size_t site_slots = 4096;     // Power of two
+static const int size_classes = 24;             // <= 8 B, <= 16 B, ... and the rest
+static Site sites[site_slots];
+static std::atomic<std::uint64_t> lost_sites;
+static std::atomic<bool> paused;
+
+// Every thread counts in its own block, which only it writes, so counting needs no locked instructions.
+// Blocks are never freed, so the report still sees the counts of finished threads.
+struct Counts {
+    std::atomic<std::uint64_t> allocations;
+    std::atomic<std::uint64_t> frees;
+    std::atomic<std::uint64_t> allocated;
+    std::atomic<std::uint64_t> histogram[size_classes];
+    std::atomic<std::int64_t> live;     // Can go negative, memory is freed by whichever thread frees it
+    std::int64_t unpublished;           // Live bytes not added to the shared total yet
+    Counts* next;
+};
+static std::atomic<Counts*> all_counts;
+static thread_local Counts* counts = nullptr;
+
+// The shared live total is only updated in 64 KB steps, so the peak is off by at most that per thread
+static const std::int64_t publish_bytes = 64 * 1024;
+static std::atomic<std::int64_t> live;
+static std::atomic<std::int64_t> peak;
+
+#if defined(__GLIBC__)
+static inline void* raw_malloc(std::size_t size) { return __libc_malloc(size); }
+static inline void* raw_calloc(std::size_t count, std::size_t size) { return __libc_calloc(count, size); }
+static inline void raw_free(void* ptr) { __libc_free(ptr); }
+static inline std::size_t usable(void* ptr) { return malloc_usable_size(ptr); }
+#else
+static inline void* raw_malloc(std::size_t size) { return std::malloc(size); }
+static inline void* raw_calloc(std::size_t count, std::size_t size) { return std::calloc(count, size); }
+static inline void raw_free(void* ptr) { std::free(ptr); }
+#ifdef __APPLE__
+static inline std::size_t usable(void* ptr) { return malloc_size(ptr); }
+#else
+static inline std::size_t usable(void* ptr) { return malloc_usable_size(ptr); }
+#endif
+#endif
+
+template <typename T>
+static inline void add(std::atomic<T>& counter, T value) {
+    counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+}
+
+static Counts* thread_counts() {
+    Counts* c = counts;
+    if (c != nullptr) return c;
+    c = static_cast<Counts*>(raw_calloc(1, sizeof(Counts)));
+    if (c == nullptr) return nullptr;
+    new (c) Counts();
+    c->next = all_counts.load();
+    while (!all_counts.compare_exchange_weak(c->next, c)) {}
+    counts = c;
+    return c;
+}
+
+static inline void add_live(Counts* c, std::int64_t bytes) {
+    add(c->live, bytes);
+    c->unpublished += bytes;
+    if (c->unpublished < publish_bytes && c->unpublished > -publish_bytes) return;
+    std::int64_t now = live.fetch_add(c->unpublished, std::memory_order_relaxed) + c->unpublished;
+    c->unpublished = 0;
+    std::int64_t high = peak.load(std::memory_order_relaxed);
+    while (now > high && !peak.compare_exchange_weak(high, now, std::memory_order_relaxed)) {}
+}
+
+static inline void on_alloc(void* ptr, std::size_t size, void* caller) {
+    if (ptr == nullptr || paused.load(std::memory_order_relaxed)) return;
+    Counts* c = thread_counts();
+    if (c == nullptr) return;
+    add<std::uint64_t>(c->allocations, 1);
+    add<std::uint64_t>(c->allocated, size);
+    int size_class = 0;
+    while (size_class < size_classes - 1 && (std::size_t(8) << size_class) < size) size_class++;
+    add<std::uint64_t>(c->histogram[size_class], 1);
+    add_live(c, static_cast<std::int64_t>(usable(ptr)));
+
+    // Open addressing on the return address, a slot is claimed once and never freed. The counts aren't
+    // locked either, so two threads allocating at the same site at once can lose one.
+    std::uintptr_t address = reinterpret_cast<std::uintptr_t>(caller);
+    std::size_t slot = static_cast<std::size_t>((address >> 2) * 0x9E3779B97F4A7C15ULL >> 52) & (site_slots - 1);
+    for (int probe = 0; probe < 32; probe++, slot = (slot + 1) & (site_slots - 1)) {
+        std::uintptr_t key = sites[slot].address.load(std::memory_order_relaxed);
+        if (key == 0 && sites[slot].address.compare_exchange_strong(key, address, std::memory_order_relaxed)) key = address;
+        if (key != address) continue;
+        add<std::uint64_t>(sites[slot].count, 1);
+        add<std::uint64_t>(sites[slot].bytes, size);
+        return;
+    }
+    lost_sites.fetch_add(1, std::memory_order_relaxed);
+}
+
+static inline void on_free_bytes(std::size_t bytes) {
+    if (paused.load(std::memory_order_relaxed)) return;
+    Counts* c = thread_counts();
+    if (c == nullptr) return;
+    add<std::uint64_t>(c->frees, 1);
+    add_live(c, -static_cast<std::int64_t>(bytes));
+}
+
+static inline void on_free(void* ptr) {
+    if (ptr != nullptr) on_free_bytes(usable(ptr));
+}
+
+static void* new_or_throw(std::size_t size, void* caller) {
+    if (size == 0) size = 1;
+    void* ptr;
+    while ((ptr = raw_malloc(size)) == nullptr) {
+        std::new_handler handler = std::get_new_handler();
+        if (handler == nullptr) throw std::bad_alloc();
+        handler();
+    }
+    on_alloc(ptr, size, caller);
+    return ptr;
+}
+
+static void* new_or_null(std::size_t size, void* caller) noexcept {
+    if (size == 0) size = 1;
+    void* ptr = raw_malloc(size);
+    on_alloc(ptr, size, caller);
+    return ptr;
+}
+
+static void release(void* ptr) noexcept {
+    on_free(ptr);
+    raw_free(ptr);
+}
+
+static const char* bytes_str(double bytes, char* buffer, std::size_t size) {
+    if (bytes >= 1024.0 * 1024.0 * 1024.0) std::snprintf(buffer, size, "%.1f GB", bytes / (1024.0 * 1024.0 * 1024.0));
+    else if (bytes >= 1024.0 * 1024.0) std::snprintf(buffer, size, "%.1f MB", bytes / (1024.0 * 1024.0));
+    else if (bytes >= 1024.0) std::snprintf(buffer, size, "%.1f KB", bytes / 1024.0);
+    else std::snprintf(buffer, size, "%.0f B", bytes);
+    return buffer;
+}
+
+static void print_site(FILE* file, std::uintptr_t address) {
+    Dl_info info;
+    std::memset(&info, 0, sizeof(info));
+    // The return address is after the call, look up the call itself
+    if (dladdr(reinterpret_cast<void*>(address - 1), &info) == 0) {
+        std::fprintf(file, "0x%llx", static_cast<unsigned long long>(address));
+        return;
+    }
+    const char* module = info.dli_fname != nullptr ? info.dli_fname : "?";
+    if (std::strrchr(module, '/') != nullptr) module = std::strrchr(module, '/') + 1;
+    if (info.dli_sname != nullptr) {
+        int status = 0;
+        char* demangled = abi::__cxa_demangle(info.dli_sname, nullptr, nullptr, &status);
+        std::fprintf(file, "%s+0x%llx", status == 0 && demangled != nullptr ? demangled : info.dli_sname,
+                     static_cast<unsigned long long>(address - reinterpret_cast<std::uintptr_t>(info.dli_saddr)));
+        std::free(demangled);
+    }
+    else std::fprintf(file, "[%s]+0x%llx", module, static_cast<unsigned long long>(address - reinterpret_cast<std::uintptr_t>(info.dli_fbase)));
+}
+
+__attribute__((destructor)) static void report() {
+    paused.store(true);
+    FILE* file = stderr;
+    const char* path = std::getenv("ZMAKE_ALLOC_REPORT");
+    if (path != nullptr && std::strlen(path) > 0) file = std::fopen(path, "a");
+    if (file == nullptr) return;
+
+    std::uint64_t total = 0;
+    std::uint64_t frees = 0;
+    std::uint64_t allocated = 0;
+    std::int64_t live_bytes = 0;
+    std::uint64_t histogram[size_classes] = {};
+    for (Counts* c = all_counts.load(); c != nullptr; c = c->next) {
+        total += c->allocations.load();
+        frees += c->frees.load();
+        allocated += c->allocated.load();
+        live_bytes += c->live.load();
+        for (int i = 0; i < size_classes; i++) histogram[i] += c->histogram[i].load();
+    }
+    char bytes[3][32];
+    std::fprintf(file, "\n- Allocation stats for pid %ld:\n", static_cast<long>(getpid()));
+    std::fprintf(file, "- %llu allocations, %llu frees, %s allocated, peak heap %s, %s still live.\n",
+                 static_cast<unsigned long long>(total), static_cast<unsigned long long>(frees),
+                 bytes_str(static_cast<double>(allocated), bytes[0], sizeof(bytes[0])),
+                 bytes_str(static_cast<double>(std::max(peak.load(), live_bytes)), bytes[1], sizeof(bytes[1])),
+                 bytes_str(static_cast<double>(std::max<std::int64_t>(live_bytes, 0)), bytes[2], sizeof(bytes[2])));
+    if (total == 0) {
+        if (file != stderr) std::fclose(file);
+        return;
+    }
+
+    std::fprintf(file, "- Sizes:\n");
+    for (int i = 0; i < size_classes; i++) {
+        std::uint64_t count = histogram[i];
+        if (count == 0) continue;
+        bytes_str(static_cast<double>(std::size_t(8) << (i == size_classes - 1 ? i - 1 : i)), bytes[0], sizeof(bytes[0]));
+        std::fprintf(file, "    %s %-9s %12llu  %5.1f%%\n", i == size_classes - 1 ? "> " : "<=", bytes[0],
+                     static_cast<unsigned long long>(count), static_cast<double>(count) * 100.0 / static_cast<double>(total));
+    }
+
+    // The ten sites with the most allocations, no sorting of the whole table needed
+    std::size_t top[10];
+    std::size_t top_num = 0;
+    for (std::size_t i = 0; i < site_slots; i++) {
+        if (sites[i].address.load() == 0) continue;
+        std::size_t j = top_num < 10 ? top_num++ : 10;
+        while (j > 0 && sites[top[j - 1]].count.load() < sites[i].count.load()) {
+            if (j < 10) top[j] = top[j - 1];
+            j--;
+        }
+        if (j < 10) top[j] = i;
+    }
+    std::fprintf(file, "- Top call sites:\n       count         bytes  site\n");
+    for (std::size_t i = 0; i < top_num; i++) {
+        std::fprintf(file, "%12llu  %12llu  ", static_cast<unsigned long long>(sites[top[i]].count.load()),
+                     static_cast<unsigned long long>(sites[top[i]].bytes.load()));
+        print_site(file, sites[top[i]].address.load());
+        std::fprintf(file, "\n");
+    }
+    if (lost_sites.load() > 0) std::fprintf(file, "- %llu allocations came from sites that didn't fit in the table.\n", static_cast<unsigned long long>(lost_sites.load()));
+    if (file != stderr) std::fclose(file);
+}
+
+}
+
+__attribute__((noinline)) void* operator new(std::size_t size) { return zmake_alloc::new_or_throw(size, __builtin_return_address(0)); }
+__attribute__((noinline)) void* operator new[](std::size_t size) { return zmake_alloc::new_or_throw(size, __builtin_return_address(0)); }
+__attribute__((noinline)) void* operator new(std::size_t size, const std::nothrow_t&) noexcept { return zmake_alloc::new_or_null(size, __builtin_return_address(0)); }
+__attribute__((noinline)) void* operator new[](std::size_t size, const std::nothrow_t&) noexcept { return zmake_alloc::new_or_null(size, __builtin_return_address(0)); }
+void operator delete(void* ptr) noexcept { zmake_alloc::release(ptr); }
+void operator delete[](void* ptr) noexcept { zmake_alloc::release(ptr); }
+void operator delete(void* ptr, std::size_t) noexcept { zmake_alloc::release(ptr); }
+void operator delete[](void* ptr, std::size_t) noexcept { zmake_alloc::release(ptr); }
+void operator delete(void* ptr, const std::nothrow_t&) noexcept { zmake_alloc::release(ptr); }
+void operator delete[](void* ptr, const std::nothrow_t&) noexcept { zmake_alloc::release(ptr); }
+
+#if defined(__GLIBC__)
+// glibc lets the program replace malloc, its own functions stay available as __libc_*.
+// Not inlined, so the return address is the caller's.
+extern "C" {
+__attribute__((noinline)) void* malloc(std::size_t size) noexcept {
+    void* ptr = __libc_malloc(size);
+    zmake_alloc::on_alloc(ptr, size, __builtin_return_address(0));
+    return ptr;
+}
+__attribute__((noinline)) void* calloc(std::size_t count, std::size_t size) noexcept {
+    void* ptr = __libc_calloc(count, size);
+    zmake_alloc::on_alloc(ptr, count * size, __builtin_return_address(0));
+    return ptr;
+}
+__attribute__((noinline)) void* realloc(void* old, std::size_t size) noexcept {
+    std::size_t old_bytes = old != nullptr ? malloc_usable_size(old) : 0;
+    void* ptr = __libc_realloc(old, size);
+    if (ptr == nullptr && size != 0) return nullptr;    // The old block is still there
+    if (old != nullptr) zmake_alloc::on_free_bytes(old_bytes);
+    zmake_alloc::on_alloc(ptr, size, __builtin_return_address(0));
+    return ptr;
+}
+void free(void* ptr) noexcept {
+    zmake_alloc::on_free(ptr);
+    __libc_free(ptr);
+}
+__attribute__((noinline)) void* memalign(std::size_t alignment, std::size_t size) noexcept {
+    void* ptr = __libc_memalign(alignment, size);
+    zmake_alloc::on_alloc(ptr, size, __builtin_return_address(0));
+    return ptr;
+}
+__attribute__((noinline)) void* aligned_alloc(std::size_t alignment, std::size_t size) noexcept {
+    void* ptr = __libc_memalign(alignment, size);
+    zmake_alloc::on_alloc(ptr, size, __builtin_return_address(0));
+    return ptr;
+}
+__attribute__((noinline)) int posix_memalign(void** out, std::size_t alignment, std::size_t size) noexcept {
+    if (alignment < sizeof(void*) || (alignment & (alignment - 1)) != 0) return EINVAL;
+    void* ptr = __libc_memalign(alignment, size);
+    if (ptr == nullptr) return ENOMEM;
+    zmake_alloc::on_alloc(ptr, size, __builtin_return_address(0));
+    *out = ptr;
+    return 0;
+}
+__attribute__((noinline)) void* valloc(std::size_t size) noexcept {
+    void* ptr = __libc_memalign(static_cast<std::size_t>(sysconf(_SC_PAGESIZE)), size);
+    zmake_alloc::on_alloc(ptr, size, __builtin_return_address(0));
+    return ptr;
+}
+}
+#endif
+
+#if defined(__clang__)
+#pragma clang diagnostic pop
+#elif defined(__GNUC__)
+#pragma GCC diagnostic pop
+#endif
+)";
+
 enum {
     STATE_UNKNOWN,
     STATE_HELP,
@@ -108,132 +631,2766 @@ enum {
     STATE_CLEAN,
     STATE_NEW,
     STATE_OPEN,
-    STATE_BUILD
+    STATE_BUILD,
+    STATE_WORKER
+};
+
+// * * * * * * * * * * FUNCTIONS * * * * * * * * * *
+template<typename... Args>
+static inline void print(Args&&... args) {
+    (std::cout << ... << std::forward<Args>(args)) << std::flush;
+}
+
+// If string is equal to ANY of the others
+template <typename... Args>
+static inline bool streq(const string& str, Args&&... args) {
+    return ((str.compare(std::forward<Args>(args)) == 0) || ...);
+}
+
+// Removes whitespace from both ends
+static inline string trim(string str) {
+    str.erase(str.begin(), std::find_if(str.begin(), str.end(), [](int ch) { return !std::isspace(ch); }));
+    str.erase(std::find_if(str.rbegin(), str.rend(), [](int ch) { return !std::isspace(ch); }).base(), str.end());
+    return str;
+}
+
+static inline bool ends_with(const string& str, const string& suffix) {
+    if (suffix.size() > str.size()) return false;
+    return std::equal(suffix.rbegin(), suffix.rend(), str.rbegin());
+}
+
+static inline string timestr(const std::time_t& time = std::time(nullptr), const char* const format = "%Y-%m-%d %H:%M:%S") {
+    #ifdef _WIN32
+    std::tm tb;
+    localtime_s(&tb, &time);
+    char mbstr[64];
+    std::strftime(mbstr, sizeof(mbstr), format, &tb);
+    #else
+    std::tm *tb;
+    tb = localtime(&time);
+    char mbstr[64];
+    std::strftime(mbstr, sizeof(mbstr), format, tb);
+    #endif
+    return string(mbstr);
+}
+
+// Returns the result of system() call, _popen for Windows compatibility
+static inline string syscall(const char* const cmd) {
+    string ret = "";
+    FILE* fpipe;
+    #ifdef _WIN32
+    fpipe = _popen(cmd, "r");
+    #else
+    fpipe = popen(cmd, "r");
+    #endif
+    if (fpipe == nullptr) return ret;
+    char c;
+    while (fread(&c, sizeof(c), 1, fpipe)) ret += c;
+    #ifdef _WIN32
+    _pclose(fpipe);
+    #else
+    pclose(fpipe);
+    #endif
+    return ret;
+}
+
+// Keeps asking the user for input until he answers yes or no
+static inline bool get_yes_or_no() {
+    string input;
+    get_the_input:
+    std::cout << "- " << std::flush;
+    getline(std::cin, input);
+    transform(input.begin(), input.end(), input.begin(), [](unsigned char c){ return toupper(c); });
+    if (input == "YES" || input == "Y" || input == "JA" || input == "J") return true;
+    else if (input == "NO" || input == "N" || input == "NEJ") {
+        std::cout << "- Exiting." << std::endl;
+        return false;
+    }
+    else goto get_the_input;
+}
+
+// Resets defaultconfig.cfg. A copy of the default from before linker = "auto" is updated to this one,
+// so new projects get the same config as a restored default.
+static inline bool reset_default_config() {
+    const char* const filename = "defaultconfig.cfg";
+    const string path = ZMAKE_ROOT + FOLDER_NOTATION + "global" + FOLDER_NOTATION + filename;
+    string old_default = DEFAULT_CFG;
+    old_default.erase(old_default.find("linker = \"auto\"\n"), 16);
+    std::ifstream qt(path, std::ios::binary);
+    std::stringstream current;
+    current << qt.rdbuf();
+    qt.close();
+    if (fs::exists(path) && current.str() == old_default) {
+        std::ofstream pt(path, std::ios::trunc);
+        pt << DEFAULT_CFG;
+    }
+    if (!fs::exists(ZMAKE_ROOT + FOLDER_NOTATION + "global" + FOLDER_NOTATION + filename)) {
+        std::ofstream pt;
+        std::cout << "- \"" << filename << "\" missing in " << ZMAKE_ROOT << FOLDER_NOTATION << "global." << std::endl;
+        std::cout << "- Do you want to restore the default? [y/n]" << std::endl;
+        if (!get_yes_or_no()) return false;
+        std::cout << "- Restoring \"" << filename << "\"." << std::endl;
+        pt.open(ZMAKE_ROOT + FOLDER_NOTATION + "global" + FOLDER_NOTATION + filename, std::ios::trunc);
+        pt << DEFAULT_CFG;
+        pt.close();
+    }
+    return true;
+}
+
+// Uses ends_with
+static inline bool is_file_include(const string& str) {
+    if (str.substr(0, 1).compare("-") == 0) return false;
+    if (ends_with(str, string(".*")))   return true;
+    if (ends_with(str, string(".c")))   return true;
+    if (ends_with(str, string(".cc")))  return true;
+    if (ends_with(str, string(".cpp"))) return true;
+    if (ends_with(str, string(".c++"))) return true;
+    if (ends_with(str, string(".cxx"))) return true;
+    if (ends_with(str, string(".zpp"))) return true;
+    if (ends_with(str, string(".z")))   return true;
+    return false;
+}
+
+static inline void change_folder_notation(string& str) {
+    for (char& c: str) if (c == '\\' || c == '/') c = FOLDER_NOTATION.at(0);
+}
+
+static inline bool str_is_in_vec(const string& str, const std::vector<string>& vec) {
+    for (const string& s: vec) if (str.compare(s) == 0) return true;
+    return false;
+}
+
+static inline bool str_is_in_vec(const string& str, const std::vector<fs::path>& vec) {
+    for (const fs::path& s: vec) if (str.compare(s.u8string()) == 0) return true;
+    return false;
+}
+
+// Reads a single value from zmake.cfg, e.g. config_value("package", "name")
+static string config_value(const string& section, const string& key, const string& fallback = "") {
+    std::ifstream cfg("zmake.cfg");
+    if (!cfg.is_open()) return fallback;
+    const std::regex reg_profile("^\\[(.*)\\](.*)");
+    const std::regex reg_flag("^(.*?)(\\s)*=(\\s)*\"(.*)\"(.*)");
+    std::smatch matches;
+    string line;
+    string current_profile = "";
+    while (getline(cfg, line)) {
+        if (std::regex_match(line, matches, reg_profile)) current_profile = matches[1];
+        else if (streq(current_profile, section) && std::regex_match(line, matches, reg_flag) && streq(key, matches[1])) return matches[4];
+    }
+    return fallback;
+}
+
+// Parses a whole string as a number, returns false if it isn't one
+static inline bool to_number(const string& str, double& value) {
+    char* end = nullptr;
+    value = std::strtod(str.c_str(), &end);
+    return !streq(str, "") && end != nullptr && *end == '\0';
+}
+
+static inline string read_file(const fs::path& path) {
+    std::ifstream file(path, std::ios::binary);
+    std::stringstream ss;
+    ss << file.rdbuf();
+    return ss.str();
+}
+
+// Gets "key": number from the flat JSON files zmake writes, returns fallback if missing
+static double json_number(const string& json, const string& key, double fallback) {
+    std::smatch matches;
+    if (!std::regex_search(json, matches, std::regex("\"" + key + "\"\\s*:\\s*([-+.0-9eE]+)"))) return fallback;
+    double value = fallback;
+    if (!to_number(matches[1], value)) return fallback;
+    return value;
+}
+
+// Gets "key": "string" from the JSON lines zmake and global.hpp write, returns fallback if missing
+static string json_string(const string& json, const string& key, const string& fallback) {
+    std::smatch matches;
+    if (!std::regex_search(json, matches, std::regex("\"" + key + "\"\\s*:\\s*\"((?:[^\"\\\\]|\\\\.)*)\""))) return fallback;
+    string value;
+    string escaped = matches[1];
+    for (std::size_t i = 0; i < escaped.length(); i++) {
+        if (escaped.at(i) == '\\' && i + 1 < escaped.length()) i++;
+        value += escaped.at(i);
+    }
+    return value;
+}
+
+static string json_escape(const string& str) {
+    string escaped;
+    for (char c: str) {
+        if (c == '"' || c == '\\') escaped += '\\';
+        escaped += c;
+    }
+    return escaped;
+}
+
+// Sets an environment variable for the programs zmake starts, or removes it if value is empty
+static void set_env(const string& name, const string& value) {
+    #ifdef _WIN32
+    _putenv_s(name.c_str(), value.c_str());
+    #else
+    if (value.empty()) unsetenv(name.c_str());
+    else setenv(name.c_str(), value.c_str(), 1);
+    #endif
+}
+
+// How run_program() should start the program
+struct RunOptions {
+    int cpu = -1;           // Pin to this CPU (Linux only), -1 for any
+    bool quiet = false;     // Send stdout to the null device
+    double timeout = 0.0;   // Kill the program after this many seconds, 0 for no limit
+    string output = "";     // Send stdout and stderr to this file (not on Windows)
+};
+
+// Resource usage of a finished program, filled in by run_program()
+struct RunStats {
+    double wall_ms = 0.0;
+    double user_ms = 0.0;
+    double sys_ms = 0.0;
+    long max_rss_kb = 0;
+    long minor_faults = 0;
+    long major_faults = 0;
+    long voluntary_switches = 0;
+    long involuntary_switches = 0;
+    bool timed_out = false;
 };
 
-// * * * * * * * * * * FUNCTIONS * * * * * * * * * *
-template<typename... Args>
-static inline void print(Args&&... args) {
-    (std::cout << ... << std::forward<Args>(args)) << std::flush;
+// Runs an executable directly (no shell) and returns its exit code, or -1 if it couldn't be started
+// On POSIX the child is reaped with wait4 so we get its rusage, on Windows only wall time is measured
+static int run_program(const string& path, const std::vector<string>& args, RunStats& stats, const RunOptions& options = RunOptions()) {
+    std::vector<string> argv_str;
+    argv_str.reserve(args.size() + 1);
+    argv_str.emplace_back(path);
+    for (const string& arg: args) argv_str.emplace_back(arg);
+    #ifdef _WIN32
+    // _spawnv joins the arguments into one command line, so they have to be quoted
+    for (string& arg: argv_str) if (arg.find(' ') != string::npos) arg = "\"" + arg + "\"";
+    #endif
+    std::vector<char*> argv;
+    argv.reserve(argv_str.size() + 1);
+    for (string& arg: argv_str) argv.emplace_back(&arg[0]);
+    argv.emplace_back(nullptr);
+    std::cout.flush();
+
+    auto a = std::chrono::steady_clock::now();
+    #ifdef _WIN32
+    // Pinning, quiet and output are not supported on Windows
+    intptr_t handle = _spawnv(_P_NOWAIT, path.c_str(), argv.data());
+    if (handle == -1) return -1;
+    DWORD wait_ms = options.timeout > 0.0 ? static_cast<DWORD>(options.timeout * 1000.0) : INFINITE;
+    if (WaitForSingleObject(reinterpret_cast<HANDLE>(handle), wait_ms) == WAIT_TIMEOUT) {
+        TerminateProcess(reinterpret_cast<HANDLE>(handle), 1);
+        stats.timed_out = true;
+    }
+    int ret = -1;
+    _cwait(&ret, handle, 0);
+    stats.wall_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - a).count();
+    return ret;
+    #else
+    pid_t pid = fork();
+    if (pid < 0) return -1;
+    if (pid == 0) {
+        #ifdef __linux__
+        if (options.cpu >= 0) {
+            cpu_set_t set;
+            CPU_ZERO(&set);
+            CPU_SET(options.cpu, &set);
+            sched_setaffinity(0, sizeof(set), &set);
+        }
+        #endif
+        if (options.quiet) {
+            int devnull = open("/dev/null", O_WRONLY);
+            if (devnull >= 0) dup2(devnull, STDOUT_FILENO);
+        }
+        if (!options.output.empty()) {
+            int out = open(options.output.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+            if (out >= 0) {
+                dup2(out, STDOUT_FILENO);
+                dup2(out, STDERR_FILENO);
+            }
+        }
+        execv(path.c_str(), argv.data());
+        _exit(127);
+    }
+    int status = 0;
+    struct rusage ru;
+    if (options.timeout > 0.0) {
+        // Poll so we can kill it once the time is up
+        pid_t done = 0;
+        while ((done = wait4(pid, &status, WNOHANG, &ru)) == 0) {
+            if (std::chrono::duration<double>(std::chrono::steady_clock::now() - a).count() > options.timeout) {
+                kill(pid, SIGKILL);
+                stats.timed_out = true;
+                done = wait4(pid, &status, 0, &ru);
+                break;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        if (done < 0) return -1;
+    }
+    else if (wait4(pid, &status, 0, &ru) < 0) return -1;
+    stats.wall_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - a).count();
+    stats.user_ms = static_cast<double>(ru.ru_utime.tv_sec) * 1000.0 + static_cast<double>(ru.ru_utime.tv_usec) / 1000.0;
+    stats.sys_ms = static_cast<double>(ru.ru_stime.tv_sec) * 1000.0 + static_cast<double>(ru.ru_stime.tv_usec) / 1000.0;
+    stats.max_rss_kb = ru.ru_maxrss;
+    #ifdef __APPLE__
+    stats.max_rss_kb /= 1024;   // Bytes on macOS
+    #endif
+    stats.minor_faults = ru.ru_minflt;
+    stats.major_faults = ru.ru_majflt;
+    stats.voluntary_switches = ru.ru_nvcsw;
+    stats.involuntary_switches = ru.ru_nivcsw;
+    if (WIFEXITED(status)) return WEXITSTATUS(status);
+    if (WIFSIGNALED(status)) return 128 + WTERMSIG(status);
+    return -1;
+    #endif
+}
+
+// Runs a command through the shell like system(), but safe to call from several threads
+static int run_command(const string& command, RunStats& stats) {
+    #ifdef _WIN32
+    auto a = std::chrono::steady_clock::now();
+    int ret = system(command.c_str());
+    stats.wall_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - a).count();
+    return ret;
+    #else
+    return run_program("/bin/sh", { "-c", command }, stats);
+    #endif
+}
+
+static inline void print_run_stats(const RunStats& stats) {
+    print("- Wall time ", stats.wall_ms, " ms, user ", stats.user_ms, " ms, sys ", stats.sys_ms, " ms.\n");
+    if (ON_WINDOWS) return;
+    print("- Max RSS ", stats.max_rss_kb, " KB, page faults ", stats.minor_faults, " minor / ", stats.major_faults, " major",
+          ", context switches ", stats.voluntary_switches, " voluntary / ", stats.involuntary_switches, " involuntary.\n");
+}
+
+// Runs the built program, used by both "open" and "run"
+static int open_program(const fs::path& path, const std::vector<string>& args, bool use_stats) {
+    RunStats stats;
+    int ret = run_program(fs::absolute(path).u8string(), args, stats);
+    if (ret == -1) {
+        print("- Couldn't run \"", path.u8string(), "\", aborting.\n");
+        return EXIT_FAILURE;
+    }
+    if (use_stats) {
+        print("\n");
+        print_run_stats(stats);
+    }
+    if (ret != 0) print("- \"", path.filename().u8string(), "\" exited with code ", ret, ".\n");
+    return ret;
+}
+
+// Workspace builds share one pool of job slots between all member builds, like make's jobserver:
+// a pipe holding one byte per free slot, handed down to the members in ZMAKE_JOBSERVER="read,write".
+// Every compiler run takes a byte before it starts and puts it back when it's done.
+static int jobserver_read = -1;
+static int jobserver_write = -1;
+
+// Joins the pool of the workspace build that started us, if any
+static inline void jobserver_connect() {
+    #ifndef _WIN32
+    const char* env = getenv("ZMAKE_JOBSERVER");
+    if (env == nullptr) return;
+    int r = -1;
+    int w = -1;
+    if (std::sscanf(env, "%d,%d", &r, &w) != 2) return;
+    if (fcntl(r, F_GETFD) < 0 || fcntl(w, F_GETFD) < 0) return;     // Not inherited
+    jobserver_read = r;
+    jobserver_write = w;
+    #endif
+}
+
+// Creates the pool for a workspace build, returns false if we already are in one
+static bool jobserver_create(unsigned int slots) {
+    #ifdef _WIN32
+    (void)slots;    // Members use their own jobs on Windows
+    return false;
+    #else
+    if (jobserver_read >= 0) return false;
+    int fds[2];
+    if (pipe(fds) != 0) return false;
+    string tokens(slots, '+');
+    if (write(fds[1], tokens.data(), tokens.size()) != static_cast<ssize_t>(tokens.size())) {
+        close(fds[0]);
+        close(fds[1]);
+        return false;
+    }
+    jobserver_read = fds[0];
+    jobserver_write = fds[1];
+    setenv("ZMAKE_JOBSERVER", (std::to_string(fds[0]) + "," + std::to_string(fds[1])).c_str(), 1);
+    return true;
+    #endif
+}
+
+static inline void jobserver_acquire() {
+    #ifndef _WIN32
+    if (jobserver_read < 0) return;
+    char token;
+    while (read(jobserver_read, &token, 1) < 0 && errno == EINTR) {}
+    #endif
+}
+
+static inline void jobserver_release() {
+    #ifndef _WIN32
+    if (jobserver_write < 0) return;
+    char token = '+';
+    while (write(jobserver_write, &token, 1) < 0 && errno == EINTR) {}
+    #endif
+}
+
+// Splits a config value on spaces, keeping "quoted strings" together
+static std::vector<string> split_args(const string& str) {
+    std::vector<string> args;
+    string arg = "";
+    bool quoted = false;
+    for (char c: str) {
+        if (c == '"') quoted = !quoted;
+        else if (c == ' ' && !quoted) {
+            if (!streq(arg, "")) args.emplace_back(arg);
+            arg = "";
+        }
+        else arg += c;
+    }
+    if (!streq(arg, "")) args.emplace_back(arg);
+    return args;
+}
+
+// A shell command for run_jobs(), started once all the jobs it depends on have succeeded
+struct Job {
+    string name;                        // Shown if it fails
+    string command;
+    std::vector<std::size_t> deps;      // Indices of the jobs that have to finish first
+    int status = -1;                    // Exit code when done, -1 if it never ran
+    bool pooled = true;                 // Takes a slot from the workspace pool while running
+    string flags = "";                  // Object jobs: the command up to "-o", so a worker can run it
+    fs::path source = "";               // Object jobs: the file compiled into object
+    fs::path object = "";
+};
+
+// A job compiling one file into an object, compile_prefix ends right before an output name ("... -o").
+// gcc and clang object jobs can be sent to "zmake worker" processes.
+static Job object_job(const string& name, const string& compile_prefix, const fs::path& source, const fs::path& object) {
+    Job job { name, compile_prefix + " \"" + object.u8string() + "\" -c \"" + source.u8string() + "\"", {}, -1 };
+    if (ends_with(compile_prefix, " -o") && !ends_with(compile_prefix.substr(0, compile_prefix.find(' ')), "cl")) {
+        job.flags = compile_prefix.substr(0, compile_prefix.length() - 3);
+        job.source = source;
+        job.object = object;
+    }
+    return job;
+}
+
+// The flags a worker compiles with. It gets preprocessed files, so it only needs code generation and
+// warning flags, and nothing that loads plugins, runs other programs or writes files of its own:
+// -O, -f and -m (but plugins, dumps, profiles and anything naming a path), -std=, -W (but -Wa, -Wl
+// and -Wp), -D, -U, -g (but -gsplit-dwarf, the .dwo would stay on the worker), -w, -pedantic,
+// -pthread and -c. Not -march=native and the like, which would target the worker's CPU instead of
+// this one's, so jobs built with them stay local.
+static bool worker_flag_allowed(const string& flag) {
+    auto starts = [&flag](const string& prefix) { return flag.compare(0, prefix.length(), prefix) == 0; };
+    if (starts("-f") || starts("-m")) {
+        if (starts("-fplugin") || starts("-fdump") || starts("-fopt-info") || starts("-fprofile") || starts("-fsave")) return false;
+        if (ends_with(flag, "=native")) return false;
+        return flag.find_first_of("/\\") == string::npos;
+    }
+    if (starts("-W")) return !starts("-Wa,") && !starts("-Wl,") && !starts("-Wp,");
+    if (starts("-g")) return !streq(flag, "-gsplit-dwarf");
+    return starts("-O") || starts("-std=") || starts("-D") || starts("-U") || starts("-pedantic") ||
+           streq(flag, "-w", "-pthread", "-c");
+}
+
+// Flags that only matter for preprocessing or linking, which happen here
+static inline bool local_only_flag(const string& flag) {
+    for (const string prefix: { "-I", "-isystem", "-iquote", "-L", "-l", "-Wl," }) {
+        if (flag.compare(0, prefix.length(), prefix) == 0) return true;
+    }
+    return false;
+}
+
+// Distributed compilation: object jobs are preprocessed here and sent to "zmake worker" processes
+// ([build] workers or -workers=), which compile them and send the objects back. Every job goes to
+// the least loaded worker, and if a worker fails the job is compiled locally instead.
+//
+// The protocol is a header line followed by raw bytes, one request per connection:
+//   "LOAD\n" -> "LOAD <jobs> <slots> <load average>\n"
+//   "COMPILE <flags bytes> <source bytes> <.i/.ii>\n" flags source -> "DONE <status> <object bytes> <log bytes>\n" object log
+// or "ERROR <message>\n" if the worker can't take the job.
+struct Worker {
+    string address;         // "host:port" or "unix:/path"
+    unsigned int slots = 1;
+    unsigned int sent = 0;  // Our jobs running on it right now
+    bool alive = true;      // Once it fails everything is compiled locally
+    double jobs = 0.0;      // Its running jobs and load average when last asked
+    double load = 0.0;
+    std::chrono::steady_clock::time_point queried {};
+};
+// How long a worker's load is trusted before asking again, our own jobs on it are counted in between
+static const std::chrono::milliseconds WORKER_LOAD_TTL(500);
+static std::vector<Worker> workers;
+static std::mutex workers_mutex;
+
+#ifndef _WIN32
+static int connect_worker(const string& address) {
+    int fd = -1;
+    if (streq(address.substr(0, 5), "unix:")) {
+        sockaddr_un addr {};
+        addr.sun_family = AF_UNIX;
+        string path = address.substr(5);
+        if (path.length() >= sizeof(addr.sun_path)) return -1;
+        std::copy(path.begin(), path.end(), addr.sun_path);
+        fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd >= 0 && connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0) {
+            close(fd);
+            fd = -1;
+        }
+        return fd;
+    }
+    std::size_t colon = address.find_last_of(':');
+    if (colon == string::npos) return -1;
+    addrinfo hints {};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo* res = nullptr;
+    if (getaddrinfo(address.substr(0, colon).c_str(), address.substr(colon + 1).c_str(), &hints, &res) != 0) return -1;
+    for (addrinfo* p = res; p != nullptr; p = p->ai_next) {
+        fd = socket(p->ai_family, p->ai_socktype, p->ai_protocol);
+        if (fd < 0) continue;
+        if (connect(fd, p->ai_addr, p->ai_addrlen) == 0) break;
+        close(fd);
+        fd = -1;
+    }
+    freeaddrinfo(res);
+    return fd;
+}
+
+static bool send_all(int fd, const string& data) {
+    std::size_t done = 0;
+    while (done < data.length()) {
+        ssize_t n = write(fd, data.data() + done, data.length() - done);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        done += static_cast<std::size_t>(n);
+    }
+    return true;
+}
+
+static bool recv_line(int fd, string& line) {
+    line = "";
+    char c;
+    while (line.length() < 4096) {
+        ssize_t n = read(fd, &c, 1);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        if (c == '\n') return true;
+        line += c;
+    }
+    return false;
+}
+
+static bool recv_bytes(int fd, std::size_t size, string& data) {
+    data.resize(size);
+    std::size_t done = 0;
+    while (done < size) {
+        ssize_t n = read(fd, &data[done], size - done);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        done += static_cast<std::size_t>(n);
+    }
+    return true;
+}
+
+// Asks a worker how busy it is, returns false if it doesn't answer
+static bool query_worker(const string& address, double& jobs, double& slots, double& load) {
+    int fd = connect_worker(address);
+    if (fd < 0) return false;
+    string line;
+    bool ok = send_all(fd, "LOAD\n") && recv_line(fd, line);
+    close(fd);
+    string tag;
+    std::istringstream iss(line);
+    return ok && (iss >> tag >> jobs >> slots >> load) && streq(tag, "LOAD") && slots >= 1.0;
+}
+#endif
+
+static inline void worker_failed(std::size_t index) {
+    std::lock_guard<std::mutex> lock(workers_mutex);
+    if (workers.at(index).alive) print("- Worker \"", workers.at(index).address, "\" failed, compiling locally instead.\n");
+    workers.at(index).alive = false;
+}
+
+// Checks that the workers answer and gets their slots, returns how many are alive
+static std::size_t connect_workers() {
+    std::size_t alive = 0;
+    #ifndef _WIN32
+    signal(SIGPIPE, SIG_IGN);   // A worker going away shouldn't kill us
+    for (Worker& worker: workers) {
+        double jobs = 0.0;
+        double slots = 0.0;
+        double load = 0.0;
+        worker.alive = query_worker(worker.address, jobs, slots, load);
+        if (!worker.alive) print("- Worker \"", worker.address, "\" isn't responding, skipping it.\n");
+        else {
+            worker.slots = static_cast<unsigned int>(slots);
+            worker.jobs = jobs;
+            worker.load = load;
+            worker.queried = std::chrono::steady_clock::now();
+            alive++;
+        }
+    }
+    #else
+    if (workers.size() > 0) print("- Distributed compilation isn't supported on Windows yet, compiling locally.\n");
+    workers.clear();
+    #endif
+    return alive;
+}
+
+// Picks the worker with the most free capacity, by its running jobs and load average
+// (asked at most every WORKER_LOAD_TTL) and what we've sent it, returns workers.size() if none is alive
+static std::size_t pick_worker() {
+    std::size_t best = workers.size();
+    #ifndef _WIN32
+    double best_score = 0.0;
+    for (std::size_t i = 0; i < workers.size(); i++) {
+        std::string address;
+        bool fresh = false;
+        {
+            std::lock_guard<std::mutex> lock(workers_mutex);
+            if (!workers.at(i).alive) continue;
+            address = workers.at(i).address;
+            fresh = std::chrono::steady_clock::now() - workers.at(i).queried < WORKER_LOAD_TTL;
+        }
+        if (!fresh) {
+            double jobs = 0.0;
+            double slots = 0.0;
+            double load = 0.0;
+            if (!query_worker(address, jobs, slots, load)) {
+                worker_failed(i);
+                continue;
+            }
+            std::lock_guard<std::mutex> lock(workers_mutex);
+            workers.at(i).jobs = jobs;
+            workers.at(i).slots = static_cast<unsigned int>(slots);
+            workers.at(i).load = load;
+            workers.at(i).queried = std::chrono::steady_clock::now();
+        }
+        double jobs = 0.0;
+        double slots = 1.0;
+        double load = 0.0;
+        double sent = 0.0;
+        {
+            std::lock_guard<std::mutex> lock(workers_mutex);
+            jobs = workers.at(i).jobs;
+            slots = static_cast<double>(workers.at(i).slots);
+            load = workers.at(i).load;
+            sent = static_cast<double>(workers.at(i).sent);
+        }
+        double score = (std::max({ jobs, load, sent }) + 1.0) / slots;
+        if (best == workers.size() || score < best_score) {
+            best = i;
+            best_score = score;
+        }
+    }
+    if (best != workers.size()) {
+        std::lock_guard<std::mutex> lock(workers_mutex);
+        workers.at(best).sent++;
+    }
+    #endif
+    return best;
+}
+
+// Compiles an object job on a worker, returns false if it has to be compiled locally.
+// The preprocessing runs here with run_local(command), so it takes a local job slot like any job.
+template <typename RunLocal>
+static bool remote_compile(const Job& job, int& status, RunLocal&& run_local) {
+    #ifdef _WIN32
+    (void)job;
+    (void)status;
+    (void)run_local;
+    return false;
+    #else
+    if (streq(job.flags, "")) return false;
+    // Workers refuse anything but worker_flag_allowed(), so jobs with other flags stay here
+    std::vector<string> args = split_args(job.flags);
+    string flags = args.at(0);
+    for (std::size_t i = 1; i < args.size(); i++) {
+        if (local_only_flag(args.at(i))) continue;
+        if (!worker_flag_allowed(args.at(i))) return false;
+        flags += args.at(i).find(' ') == string::npos ? " " + args.at(i) : " \"" + args.at(i) + "\"";
+    }
+    {
+        std::lock_guard<std::mutex> lock(workers_mutex);
+        bool any = false;
+        for (const Worker& worker: workers) if (worker.alive) any = true;
+        if (!any) return false;
+    }
+    // Preprocess here, so the worker doesn't need our headers
+    string ext = streq(job.source.extension().u8string(), ".c") ? ".i" : ".ii";
+    fs::path preprocessed = job.object;
+    preprocessed += ext;
+    status = run_local(job.flags + " -E \"" + job.source.u8string() + "\" -o \"" + preprocessed.u8string() + "\"");
+    if (status != 0) return true;
+    string source = read_file(preprocessed);
+    fs::remove(preprocessed);
+
+    for (std::size_t index = pick_worker(); index != workers.size(); index = pick_worker()) {
+        string address = workers.at(index).address;
+        int fd = connect_worker(address);
+        string line;
+        string object;
+        string log;
+        bool ok = fd >= 0 && send_all(fd, "COMPILE " + std::to_string(flags.length()) + " " + std::to_string(source.length()) + " " + ext + "\n") &&
+                  send_all(fd, flags) && send_all(fd, source) && recv_line(fd, line);
+        string tag;
+        std::size_t object_size = 0;
+        std::size_t log_size = 0;
+        std::istringstream iss(line);
+        ok = ok && (iss >> tag >> status >> object_size >> log_size) && streq(tag, "DONE") &&
+             recv_bytes(fd, object_size, object) && recv_bytes(fd, log_size, log);
+        if (fd >= 0) close(fd);
+        {
+            std::lock_guard<std::mutex> lock(workers_mutex);
+            workers.at(index).sent--;
+        }
+        if (!ok) {
+            if (streq(tag, "ERROR")) print("- Worker \"", address, "\": ", line.substr(6), "\n");
+            worker_failed(index);
+            continue;
+        }
+        if (!streq(log, "")) print(log);
+        if (status == 127) return false;    // Worker doesn't have the compiler
+        if (status != 0) return true;
+        std::ofstream pt(job.object, std::ios::binary | std::ios::trunc);
+        pt << object;
+        return true;
+    }
+    return false;
+    #endif
+}
+
+// Memory-aware scheduling: with max_memory ([build] max_memory or -max_memory=) local jobs only start
+// while the estimated memory of all running jobs fits in it. Estimates are the peak RSS from earlier
+// builds, kept in build/memory.history, or a guess from the size of the file.
+static std::uint64_t max_memory_kb = 0;     // 0 for no limit
+static bool report_memory = false;          // Print the peak memory of every job
+
+// A value from /proc/meminfo in kB, 0 if it isn't there (or not on Linux)
+static std::uint64_t meminfo_kb(const string& key) {
+    std::ifstream meminfo("/proc/meminfo");
+    string line;
+    while (getline(meminfo, line)) {
+        if (line.compare(0, key.length() + 1, key + ":") != 0) continue;
+        return std::strtoull(line.substr(key.length() + 1).c_str(), nullptr, 10);
+    }
+    return 0;
+}
+
+// Parses sizes like "8G", "512M" or "auto" (90% of the memory) into kB, plain numbers are MB
+static bool to_kilobytes(const string& str, std::uint64_t& kb) {
+    if (streq(str, "auto")) {
+        kb = meminfo_kb("MemTotal") / 10 * 9;
+        return kb != 0;
+    }
+    string number = str;
+    double scale = 1024.0;
+    if (ends_with(number, "B") || ends_with(number, "b")) number.pop_back();
+    if (number.length() > 0) {
+        char unit = static_cast<char>(toupper(static_cast<unsigned char>(number.back())));
+        if (unit == 'K' || unit == 'M' || unit == 'G' || unit == 'T') number.pop_back();
+        if (unit == 'K') scale = 1.0;
+        if (unit == 'G') scale = 1024.0 * 1024.0;
+        if (unit == 'T') scale = 1024.0 * 1024.0 * 1024.0;
+    }
+    double value = 0.0;
+    if (!to_number(number, value) || value <= 0.0) return false;
+    kb = static_cast<std::uint64_t>(value * scale);
+    return true;
+}
+
+static inline string memory_key(const Job& job) {
+    return job.object.empty() ? job.name : job.object.u8string();
+}
+
+static std::map<string, std::uint64_t> read_memory_history() {
+    std::map<string, std::uint64_t> history;
+    std::ifstream file("build" + FOLDER_NOTATION + "memory.history");
+    std::uint64_t kb = 0;
+    string key;
+    while (file >> kb && getline(file, key)) history[trim(key)] = kb;
+    return history;
+}
+
+static void write_memory_history(const std::map<string, std::uint64_t>& history) {
+    if (!fs::exists("build")) return;
+    std::ofstream file("build" + FOLDER_NOTATION + "memory.history", std::ios::trunc);
+    for (const auto& entry: history) file << entry.second << " " << entry.first << "\n";
+}
+
+// Peak RSS of the last build of this job, or a guess from the size of the file and the files
+// it #includes by path, like the unity files zmake writes
+static std::uint64_t estimate_memory(const Job& job, const std::map<string, std::uint64_t>& history) {
+    auto it = history.find(memory_key(job));
+    if (it != history.end()) return it->second;
+    std::uintmax_t bytes = 0;
+    std::error_code ec;
+    if (!job.source.empty() && fs::exists(job.source, ec)) {
+        bytes = fs::file_size(job.source, ec);
+        std::ifstream file(job.source);
+        string line;
+        std::smatch matches;
+        const std::regex reg_include("^#include \"(.*)\"(.*)");
+        while (getline(file, line)) {
+            if (!std::regex_match(line, matches, reg_include)) continue;
+            fs::path included = string(matches[1]);
+            if (included.is_absolute() && fs::exists(included, ec)) bytes += fs::file_size(included, ec);
+        }
+    }
+    return 256 * 1024 + bytes / 1024 * 64;
+}
+
+// Runs the jobs on up to max_jobs threads in dependency order, skipping jobs whose
+// dependencies failed. Returns true if every job succeeded.
+static bool run_jobs(std::vector<Job>& jobs, unsigned int max_jobs, bool use_cmd) {
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::vector<int> job_state(jobs.size(), 0);     // 0 waiting, 1 running, 2 done
+    std::vector<long> peak_kb(jobs.size(), 0);
+    std::size_t finished = 0;
+    unsigned int local_running = 0;
+    std::uint64_t reserved_kb = 0;                  // Estimated memory of the local jobs running
+    std::map<string, std::uint64_t> history = read_memory_history();
+    bool success = true;
+
+    // A job may start when it fits in max_memory and MemAvailable, and the machine isn't
+    // already busy with other things. One job can always run, however big it is.
+    auto admit = [&](std::uint64_t estimate) {
+        if (local_running >= std::max(1U, max_jobs)) return false;
+        if (max_memory_kb == 0 || local_running == 0) return true;
+        if (reserved_kb + estimate > max_memory_kb) return false;
+        std::uint64_t available = meminfo_kb("MemAvailable");
+        if (available != 0 && estimate > available) return false;
+        double load = 0.0;
+        #ifndef _WIN32
+        if (getloadavg(&load, 1) != 1) load = 0.0;
+        #endif
+        return load - local_running < std::max(1U, std::thread::hardware_concurrency());
+    };
+
+    // Runs a command once admit() lets it, in a slot from the workspace pool if pooled. Free memory
+    // and load change on their own, so check them again every 100 ms while waiting.
+    auto run_local = [&](const string& command, std::uint64_t estimate, bool pooled, RunStats& stats) {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (!admit(estimate)) cv.wait_for(lock, std::chrono::milliseconds(100));
+        local_running++;
+        reserved_kb += estimate;
+        lock.unlock();
+        if (pooled) jobserver_acquire();
+        int status = run_command(command, stats);
+        if (pooled) jobserver_release();
+        lock.lock();
+        local_running--;
+        reserved_kb -= estimate;
+        cv.notify_all();
+        return status;
+    };
+
+    auto worker = [&]() {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (finished < jobs.size()) {
+            std::size_t next = jobs.size();
+            for (std::size_t i = 0; i < jobs.size() && next == jobs.size(); i++) {
+                if (job_state.at(i) != 0) continue;
+                bool ready = true;
+                bool skip = false;
+                for (std::size_t dep: jobs.at(i).deps) {
+                    if (job_state.at(dep) != 2) ready = false;
+                    else if (jobs.at(dep).status != 0) skip = true;
+                }
+                if (skip) {
+                    job_state.at(i) = 2;
+                    finished++;
+                    cv.notify_all();
+                }
+                else if (ready) next = i;
+            }
+            if (next == jobs.size()) {
+                if (finished < jobs.size()) cv.wait(lock);
+                continue;
+            }
+            job_state.at(next) = 1;
+            if (use_cmd) print(jobs.at(next).command, "\n");
+            lock.unlock();
+
+            // Jobs sent to workers only count against the local jobs and memory while preprocessing
+            const Job& job = jobs.at(next);
+            std::uint64_t estimate = estimate_memory(job, history);
+            auto preprocess = [&](const string& command) {
+                RunStats preprocess_stats;
+                return run_local(command, estimate, job.pooled, preprocess_stats);
+            };
+            int status = 0;
+            if (!remote_compile(job, status, preprocess)) {
+                RunStats stats;
+                status = run_local(job.command, estimate, job.pooled, stats);
+                lock.lock();
+                peak_kb.at(next) = stats.max_rss_kb;
+                lock.unlock();
+            }
+
+            lock.lock();
+            jobs.at(next).status = status;
+            job_state.at(next) = 2;
+            finished++;
+            if (status != 0) {
+                print("- \"", jobs.at(next).name, "\" failed with code ", status, ".\n");
+                success = false;
+            }
+            cv.notify_all();
+        }
+    };
+
+    std::vector<std::thread> threads;
+    unsigned int thread_num = std::max(1U, max_jobs);
+    for (const Worker& w: workers) if (w.alive) thread_num += w.slots;
+    thread_num = static_cast<unsigned int>(std::min<std::size_t>(thread_num, jobs.size()));
+    for (unsigned int i = 0; i < thread_num; i++) threads.emplace_back(worker);
+    for (std::thread& thread: threads) thread.join();
+    for (const Job& job: jobs) if (job.status != 0) success = false;
+
+    std::vector<std::size_t> measured;
+    for (std::size_t i = 0; i < jobs.size(); i++) {
+        if (peak_kb.at(i) <= 0) continue;
+        history[memory_key(jobs.at(i))] = static_cast<std::uint64_t>(peak_kb.at(i));
+        measured.emplace_back(i);
+    }
+    write_memory_history(history);
+    if (report_memory && measured.size() > 0) {
+        std::sort(measured.begin(), measured.end(), [&](std::size_t x, std::size_t y) { return peak_kb.at(x) > peak_kb.at(y); });
+        std::ostringstream report;
+        report << std::fixed << std::setprecision(1) << "- Peak memory per job:\n";
+        for (std::size_t i = 0; i < measured.size() && i < 10; i++) {
+            report << "    " << std::setw(9) << static_cast<double>(peak_kb.at(measured.at(i))) / 1024.0 << " MB  " << jobs.at(measured.at(i)).name << "\n";
+        }
+        if (measured.size() > 10) report << "    and " << measured.size() - 10 << " smaller jobs.\n";
+        print(report.str());
+    }
+    return success;
+}
+
+// A [target.name] section in zmake.cfg, one executable per entry file.
+// Tests from /tests and [test.name] are targets too, only built by "zmake test".
+struct Target {
+    string name;
+    fs::path entry;
+    bool test = false;
+    double timeout = -1.0;      // Seconds, -1 for the [test] default
+    string flags = "";          // Added to the profile's flags for this target only
+};
+
+// A [library.name] section in zmake.cfg, a subdirectory of /src or another zmake project
+struct Library {
+    string name;
+    fs::path path;
+    bool shared = false;
+};
+
+// Sources of a library, a zmake project keeps them in /src
+static inline fs::path library_sources(const Library& library) {
+    if (fs::exists(library.path / "zmake.cfg")) return library.path / "src";
+    return library.path;
+}
+
+static inline bool is_in_directory(const fs::path& path, const fs::path& dir) {
+    string p = fs::absolute(path).lexically_normal().u8string();
+    string d = fs::absolute(dir).lexically_normal().u8string();
+    if (!ends_with(d, FOLDER_NOTATION)) d += FOLDER_NOTATION;
+    return p.compare(0, d.length(), d) == 0;
+}
+
+// Settings for "zmake bench", from [bench] in zmake.cfg and flags
+struct BenchOptions {
+    int runs = 10;
+    int warmup = 1;
+    int cpu = -1;
+    double threshold = 5.0;     // Allowed slowdown of the median in percent
+    bool save_baseline = false;
+    fs::path results = "";
+    fs::path baseline = "";
+    fs::path micro = "";        // Where bench() in global.hpp appends its results in the timed runs, if set
+};
+
+// Sorted samples in, nearest-rank percentile out
+static inline double percentile(const std::vector<double>& sorted, double p) {
+    std::size_t rank = static_cast<std::size_t>(std::ceil(p / 100.0 * static_cast<double>(sorted.size())));
+    if (rank > 0) rank--;
+    return sorted.at(std::min(rank, sorted.size() - 1));
+}
+
+static inline double median_of(const std::vector<double>& sorted) {
+    return sorted.size() % 2 == 1 ? sorted.at(sorted.size() / 2)
+         : (sorted.at(sorted.size() / 2 - 1) + sorted.at(sorted.size() / 2)) / 2.0;
+}
+
+// Runs the program warmup + runs times and collects the wall times of the timed runs,
+// returns false if it fails
+static bool bench_samples(const fs::path& path, const std::vector<string>& args, const BenchOptions& options,
+                          std::vector<double>& samples, long& max_rss_kb) {
+    RunOptions run_options;
+    run_options.cpu = options.cpu;
+    run_options.quiet = true;
+    string program = fs::absolute(path).u8string();
+    samples.clear();
+    samples.reserve(static_cast<std::size_t>(options.runs));
+    max_rss_kb = 0;
+    if (!options.micro.empty()) set_env("ZMAKE_BENCH_JSON", fs::absolute(options.micro).u8string());
+    for (int i = 0; i < options.warmup + options.runs; i++) {
+        if (!options.micro.empty() && i == options.warmup) fs::remove(options.micro);     // Only the timed runs count
+        RunStats stats;
+        int ret = run_program(program, args, stats, run_options);
+        if (ret != 0) {
+            set_env("ZMAKE_BENCH_JSON", "");
+            print("- \"", path.filename().u8string(), "\" exited with code ", ret, ", aborting.\n");
+            return false;
+        }
+        if (i < options.warmup) continue;
+        samples.emplace_back(stats.wall_ms);
+        max_rss_kb = std::max(max_rss_kb, stats.max_rss_kb);
+    }
+    set_env("ZMAKE_BENCH_JSON", "");
+    return true;
+}
+
+// A bench() from global.hpp over all the runs
+struct MicroBench {
+    string name;
+    std::vector<double> ns_per_op;  // One per run
+    double items_per_op = 1.0;
+    double median = 0.0;
+};
+
+// Groups the JSON lines bench() wrote by name, in the order they first ran
+static std::vector<MicroBench> read_micro_benches(const fs::path& path) {
+    std::vector<MicroBench> benches;
+    std::istringstream iss(read_file(path));
+    string line;
+    while (getline(iss, line)) {
+        string name = json_string(line, "name", "");
+        double ns = json_number(line, "ns_per_op", -1.0);
+        if (streq(name, "") || ns < 0.0) continue;
+        auto it = std::find_if(benches.begin(), benches.end(), [&](const MicroBench& bench) { return bench.name == name; });
+        if (it == benches.end()) {
+            benches.emplace_back();
+            it = benches.end() - 1;
+            it->name = name;
+            it->items_per_op = json_number(line, "items_per_op", 1.0);
+        }
+        it->ns_per_op.emplace_back(ns);
+    }
+    for (MicroBench& bench: benches) {
+        std::sort(bench.ns_per_op.begin(), bench.ns_per_op.end());
+        bench.median = median_of(bench.ns_per_op);
+    }
+    return benches;
+}
+
+// Runs the program repeatedly, saves the results as JSON and compares the median against the baseline
+static int run_bench(const fs::path& path, const std::vector<string>& args, const BenchOptions& options) {
+    string progname = path.filename().u8string();
+
+    print("- Benchmarking \"", progname, "\" with ", options.warmup, " warmup and ", options.runs, " timed runs");
+    if (options.cpu >= 0) print(" on CPU ", options.cpu);
+    print(".\n");
+
+    std::vector<double> samples;
+    long max_rss_kb = 0;
+    BenchOptions run_options = options;
+    run_options.micro = options.results;
+    run_options.micro.replace_extension(".micro.jsonl");
+    if (!bench_samples(path, args, run_options, samples, max_rss_kb)) return EXIT_FAILURE;
+    std::vector<MicroBench> micro = read_micro_benches(run_options.micro);
+
+    std::vector<double> sorted = samples;
+    std::sort(sorted.begin(), sorted.end());
+    double mean = 0.0;
+    for (double x: sorted) mean += x;
+    mean /= static_cast<double>(sorted.size());
+    double variance = 0.0;
+    for (double x: sorted) variance += (x - mean) * (x - mean);
+    if (sorted.size() > 1) variance /= static_cast<double>(sorted.size() - 1);
+    double median = median_of(sorted);
+    double p95 = percentile(sorted, 95.0);
+    double stddev = std::sqrt(variance);
+
+    print("- min ", sorted.front(), " ms, median ", median, " ms, mean ", mean, " ms, p95 ", p95, " ms, stddev ", stddev, " ms.\n");
+
+    // The program's bench() results, the median of every run's median
+    if (!micro.empty()) {
+        std::ostringstream table;
+        table << std::fixed << std::setprecision(2);
+        table << "- " << micro.size() << " benchmarks from bench(), over " << options.runs << " runs:\n";
+        table << "    " << std::left << std::setw(32) << "name" << std::right << std::setw(14) << "median ns/op"
+              << std::setw(12) << "min" << std::setw(10) << "stddev" << std::setw(16) << "items/s" << "\n";
+        for (const MicroBench& bench: micro) {
+            double bench_mean = 0.0, bench_variance = 0.0;
+            for (double x: bench.ns_per_op) bench_mean += x;
+            bench_mean /= static_cast<double>(bench.ns_per_op.size());
+            for (double x: bench.ns_per_op) bench_variance += (x - bench_mean) * (x - bench_mean);
+            if (bench.ns_per_op.size() > 1) bench_variance /= static_cast<double>(bench.ns_per_op.size() - 1);
+            std::ostringstream deviation;
+            deviation << std::fixed << std::setprecision(1) << (bench.median > 0.0 ? std::sqrt(bench_variance) / bench.median * 100.0 : 0.0) << "%";
+            table << "    " << std::left << std::setw(32) << bench.name << std::right << std::setw(14) << bench.median
+                  << std::setw(12) << bench.ns_per_op.front() << std::setw(10) << deviation.str() << std::setw(16) << std::setprecision(0)
+                  << (bench.median > 0.0 ? bench.items_per_op * 1e9 / bench.median : 0.0) << std::setprecision(2) << "\n";
+        }
+        print(table.str());
+    }
+
+    std::ostringstream json;
+    json << std::setprecision(6) << std::fixed;
+    json << "{\n";
+    json << "    \"program\": \"" << progname << "\",\n";
+    json << "    \"date\": \"" << timestr() << "\",\n";
+    json << "    \"runs\": " << options.runs << ",\n";
+    json << "    \"warmup\": " << options.warmup << ",\n";
+    json << "    \"cpu\": " << options.cpu << ",\n";
+    json << "    \"min_ms\": " << sorted.front() << ",\n";
+    json << "    \"median_ms\": " << median << ",\n";
+    json << "    \"mean_ms\": " << mean << ",\n";
+    json << "    \"p95_ms\": " << p95 << ",\n";
+    json << "    \"max_ms\": " << sorted.back() << ",\n";
+    json << "    \"stddev_ms\": " << stddev << ",\n";
+    json << "    \"max_rss_kb\": " << max_rss_kb << ",\n";
+    json << "    \"micro\": [";
+    for (std::size_t i = 0; i < micro.size(); i++) {
+        const MicroBench& bench = micro.at(i);
+        json << (i == 0 ? "\n" : ",\n") << "        {\"name\": \"" << json_escape(bench.name) << "\", \"median_ns\": " << bench.median
+             << ", \"min_ns\": " << bench.ns_per_op.front() << ", \"max_ns\": " << bench.ns_per_op.back()
+             << ", \"items_per_op\": " << bench.items_per_op << ", \"runs\": " << bench.ns_per_op.size() << "}";
+    }
+    json << (micro.empty() ? "],\n" : "\n    ],\n");
+    json << "    \"samples_ms\": [";
+    for (std::size_t i = 0; i < samples.size(); i++) json << (i == 0 ? "" : ", ") << samples.at(i);
+    json << "]\n}\n";
+
+    std::ofstream pt(options.results, std::ios::trunc);
+    pt << json.str();
+    pt.close();
+    print("- Saved results to \"", options.results.u8string(), "\".\n");
+
+    if (options.save_baseline) {
+        if (options.baseline.has_parent_path()) fs::create_directories(options.baseline.parent_path());
+        pt.open(options.baseline, std::ios::trunc);
+        pt << json.str();
+        pt.close();
+        print("- Saved baseline to \"", options.baseline.u8string(), "\".\n");
+        return EXIT_SUCCESS;
+    }
+    if (!fs::exists(options.baseline)) {
+        print("- No baseline found, save one with \"zmake bench -save\".\n");
+        return EXIT_SUCCESS;
+    }
+
+    double base_median = json_number(read_file(options.baseline), "median_ms", -1.0);
+    if (base_median <= 0.0) {
+        print("- Couldn't read median from baseline \"", options.baseline.u8string(), "\", aborting.\n");
+        return EXIT_FAILURE;
+    }
+    double change = (median - base_median) / base_median * 100.0;
+    print("- Baseline median ", base_median, " ms, change ", (change >= 0.0 ? "+" : ""), change, "% (threshold ", options.threshold, "%).\n");
+    bool regressed = change > options.threshold;
+
+    // Every bench() that's in the baseline too, the baseline has one per line
+    std::istringstream baseline(read_file(options.baseline));
+    string line;
+    while (getline(baseline, line)) {
+        string name = json_string(line, "name", "");
+        double base_ns = json_number(line, "median_ns", -1.0);
+        auto it = std::find_if(micro.begin(), micro.end(), [&](const MicroBench& bench) { return bench.name == name; });
+        if (streq(name, "") || base_ns <= 0.0 || it == micro.end()) continue;
+        double bench_change = (it->median - base_ns) / base_ns * 100.0;
+        print("    ", name, ": ", base_ns, " -> ", it->median, " ns/op, ", (bench_change >= 0.0 ? "+" : ""), bench_change, "%");
+        if (bench_change > options.threshold) {
+            print(", regression");
+            regressed = true;
+        }
+        print("\n");
+    }
+    if (regressed) {
+        print("- Performance regression, failing.\n");
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
+// Settings for "zmake test", from [test] in zmake.cfg and flags
+struct TestOptions {
+    double timeout = 60.0;      // Seconds per test, 0 for no limit
+    unsigned int shard = 1;     // Run shard i of n (-shard=i/n), counting from 1
+    unsigned int shards = 1;
+};
+
+// The exit code of a test that can't run here, like one for a CPU feature the machine doesn't have (as in automake)
+static const int TEST_SKIPPED = 77;
+
+// Runs the test executables on up to max_jobs threads, each with its output in build/tests/<name>.log,
+// which is shown if it fails or is skipped. Tests get ZMAKE_ROOT in their environment. Prints every result as it finishes and the slowest tests at the end.
+static int run_tests(const std::vector<Target>& tests, const std::vector<fs::path>& outputs, const std::vector<string>& args,
+                     const TestOptions& options, unsigned int max_jobs) {
+    std::mutex mutex;
+    std::size_t next = 0;
+    std::vector<int> status(tests.size(), -1);
+    std::vector<RunStats> results(tests.size());
+    set_env("ZMAKE_ROOT", ZMAKE_ROOT);
+
+    auto worker = [&]() {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (next < tests.size()) {
+            std::size_t i = next++;
+            lock.unlock();
+
+            RunOptions run_options;
+            run_options.timeout = tests.at(i).timeout >= 0.0 ? tests.at(i).timeout : options.timeout;
+            fs::path log = outputs.at(i).parent_path() / (tests.at(i).name + ".log");
+            run_options.output = log.u8string();
+            int ret = run_program(fs::absolute(outputs.at(i)).u8string(), args, results.at(i), run_options);
+
+            lock.lock();
+            status.at(i) = ret;
+            std::ostringstream line;
+            line << std::fixed << std::setprecision(1);
+            if (ret == 0) line << "- PASS    " << tests.at(i).name << " (" << results.at(i).wall_ms << " ms)\n";
+            else if (ret == TEST_SKIPPED) line << "- SKIP    " << tests.at(i).name << " (" << results.at(i).wall_ms << " ms)\n";
+            else if (results.at(i).timed_out) line << "- TIMEOUT " << tests.at(i).name << " (killed after " << run_options.timeout << " s)\n";
+            else if (ret == -1) line << "- FAIL    " << tests.at(i).name << ", couldn't run it\n";
+            else line << "- FAIL    " << tests.at(i).name << " (" << results.at(i).wall_ms << " ms), exited with code " << ret << "\n";
+            print(line.str());
+            if (ret != 0 && fs::exists(log) && fs::file_size(log) > 0) print(read_file(log), "\n");
+        }
+    };
+
+    print("- Running ", tests.size(), " tests");
+    if (options.shards > 1) print(" (shard ", options.shard, "/", options.shards, ")");
+    print(" with ", std::min<std::size_t>(std::max(1U, max_jobs), tests.size()), " jobs:\n");
+    auto a = std::chrono::steady_clock::now();
+    std::vector<std::thread> threads;
+    unsigned int thread_num = static_cast<unsigned int>(std::min<std::size_t>(std::max(1U, max_jobs), tests.size()));
+    for (unsigned int i = 0; i < thread_num; i++) threads.emplace_back(worker);
+    for (std::thread& thread: threads) thread.join();
+    std::chrono::duration<double, std::milli> fp_tests = std::chrono::steady_clock::now() - a;
+
+    std::size_t passed = 0;
+    std::size_t skipped = 0;
+    std::size_t timed_out = 0;
+    std::vector<std::size_t> slowest;
+    for (std::size_t i = 0; i < tests.size(); i++) {
+        if (status.at(i) == 0) passed++;
+        else if (status.at(i) == TEST_SKIPPED) skipped++;
+        else if (results.at(i).timed_out) timed_out++;
+        slowest.emplace_back(i);
+    }
+    std::sort(slowest.begin(), slowest.end(), [&](std::size_t x, std::size_t y) { return results.at(x).wall_ms > results.at(y).wall_ms; });
+    if (slowest.size() > 5) slowest.resize(5);
+
+    std::ostringstream report;
+    report << std::fixed << std::setprecision(1);
+    report << "\n- Slowest tests:\n";
+    for (std::size_t i: slowest) report << "    " << std::setw(10) << results.at(i).wall_ms << " ms  " << tests.at(i).name << "\n";
+    report << "- " << passed << " passed, ";
+    if (skipped > 0) report << skipped << " skipped, ";
+    report << tests.size() - passed - skipped - timed_out << " failed, " << timed_out << " timed out, in " << fp_tests.count() << " ms.\n";
+    print(report.str());
+    return passed + skipped == tests.size() ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+// Looks for an executable in PATH
+static fs::path find_in_path(const string& name) {
+    const char* path = getenv("PATH");
+    if (path == nullptr) return "";
+    std::istringstream iss(path);
+    string dir;
+    std::error_code ec;
+    while (getline(iss, dir, ON_WINDOWS ? ';' : ':')) {
+        if (streq(dir, "")) continue;
+        if (fs::exists(fs::path(dir) / name, ec)) return fs::path(dir) / name;
+        if (fs::exists(fs::path(dir) / (name + ".exe"), ec)) return fs::path(dir) / (name + ".exe");
+    }
+    return "";
+}
+
+static inline bool in_path(const string& name) {
+    return !find_in_path(name).empty();
+}
+
+// If compiler takes -fuse-ld=linker, from linking an empty program in build/
+static bool links_with(const string& compiler, const string& linker) {
+    std::error_code error;
+    fs::create_directories("build", error);
+    fs::path source = "build" + FOLDER_NOTATION + "zmake_linker.cpp", output = "build" + FOLDER_NOTATION + "zmake_linker";
+    std::ofstream pt(source, std::ios::trunc);
+    pt << "int main() { return 0; }\n";
+    pt.close();
+    RunStats stats;
+    int ret = run_command(compiler + " -fuse-ld=" + linker + " \"" + source.u8string() + "\" -o \"" + output.u8string() + "\"" +
+                          (ON_WINDOWS ? " > NUL 2>&1" : " > /dev/null 2>&1"), stats);
+    fs::remove(source, error);
+    fs::remove(output, error);
+    fs::remove(output.u8string() + ".exe", error);
+    return ret == 0;
+}
+
+// Picks the fastest installed linker that compiler takes, for linker = "auto". gcc before 12.1 doesn't
+// take mold, so each one is tried first, and the choice is kept in build/linker.cache per compiler.
+static string detect_linker(const string& compiler) {
+    if (ends_with(compiler, "cl")) return "default";
+    const fs::path cache = "build" + FOLDER_NOTATION + "linker.cache";
+    std::ifstream in(cache);
+    string linker, cached_compiler;
+    while (in >> linker && getline(in, cached_compiler)) {
+        if (streq(trim(cached_compiler), compiler)) return linker;
+    }
+    in.close();
+    linker = "default";
+    if (in_path("ld.mold") && links_with(compiler, "mold")) linker = "mold";
+    else if ((in_path("ld.lld") || in_path("lld-link")) && links_with(compiler, "lld")) linker = "lld";
+    else if (in_path("ld.gold") && links_with(compiler, "gold")) linker = "gold";
+    std::ofstream out(cache, std::ios::app);
+    out << linker << " " << compiler << "\n";
+    return linker;
+}
+
+static inline bool is_clang(const string& compiler) {
+    return compiler.find("clang") != string::npos;
+}
+
+// 64-bit FNV-1a, used to fingerprint commands and sources
+static inline std::uint64_t fnv1a(const string& str, std::uint64_t hash = 14695981039346656037ULL) {
+    for (unsigned char c: str) {
+        hash ^= c;
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+static inline string to_hex(std::uint64_t value) {
+    std::ostringstream ss;
+    ss << std::hex << std::setw(16) << std::setfill('0') << value;
+    return ss.str();
+}
+
+// Hash of everything in dirs (their build folders aside), so we can tell if a stored profile is stale
+static string hash_sources(const std::vector<fs::path>& dirs, std::uint64_t hash = 14695981039346656037ULL) {
+    std::vector<fs::path> files;
+    for (const fs::path& dir: dirs) {
+        if (!fs::is_directory(dir)) continue;
+        for (const auto& p: fs::recursive_directory_iterator(dir)) {
+            if (fs::is_directory(p.path()) || is_in_directory(p.path(), dir / "build")) continue;
+            files.emplace_back(p.path());
+        }
+    }
+    std::sort(files.begin(), files.end());
+    for (const fs::path& file: files) {
+        hash = fnv1a(file.u8string(), hash);
+        hash = fnv1a(read_file(file), hash);
+    }
+    return to_hex(hash);
+}
+
+// Settings for "zmake pgo", from [pgo] in zmake.cfg and flags
+struct PgoOptions {
+    bool retrain = false;
+    std::vector<string> args;   // Training arguments for the program itself
+    string command = "";        // Or a training command, where $PROGRAM is the instrumented executable
+};
+
+// Builds an instrumented executable, trains it and merges the profile, unless the stored profile
+// for this exact compile command is still fresh, with nothing in source_dirs changed since.
+// Profiles live in build/pgo/<fingerprint>.
+// compile_prefix ends right before the output name. The instrumented build uses the same output name,
+// since gcc names the .gcda files after it. Returns the -fprofile-use flags, or "" on failure.
+static string pgo_train(const string& compiler, const string& compile_prefix, const string& link_string,
+                        const fs::path& output, const std::vector<fs::path>& source_dirs, const PgoOptions& options, bool use_cmd) {
+    if (streq(compiler, "cl")) {
+        print("- PGO is only supported with gcc and clang, aborting.\n");
+        return "";
+    }
+    string fingerprint = to_hex(fnv1a(compile_prefix + link_string));
+    fs::path dir = fs::absolute("build" + FOLDER_NOTATION + "pgo" + FOLDER_NOTATION + fingerprint);
+    fs::path profdata = dir / "zmake.profdata";
+    fs::path stamp = dir / "sources.txt";
+
+    string training = options.command;
+    for (const string& arg: options.args) training += " " + arg;
+    string sources = hash_sources(source_dirs, fnv1a(training));
+
+    string use_flag;
+    if (is_clang(compiler)) use_flag = "-fprofile-use=\"" + profdata.u8string() + "\"";
+    else use_flag = "-fprofile-use=\"" + dir.u8string() + "\" -fprofile-correction -Wno-missing-profile";
+
+    // gcc puts the .gcda files in subdirectories mirroring the object paths
+    bool has_profile = false;
+    if (fs::exists(dir)) {
+        for (const auto& p: fs::recursive_directory_iterator(dir)) {
+            if (streq(p.path().extension().u8string(), ".profdata", ".gcda")) has_profile = true;
+        }
+    }
+    if (!options.retrain && has_profile && streq(read_file(stamp), sources)) {
+        print("- Using stored profile ", fingerprint, ", sources unchanged since training.\n");
+        return use_flag;
+    }
+    if (has_profile) print("- Stored profile ", fingerprint, " is stale, retraining.\n");
+
+    fs::remove_all(dir);
+    fs::create_directories(dir);
+    fs::path instrumented = fs::absolute(output);
+    string gen_string = compiler + " -fprofile-generate=\"" + dir.u8string() + "\"" + compile_prefix.substr(compiler.length()) +
+                        " \"" + output.u8string() + "\"" + link_string;
+    if (use_cmd) print("- Building instrumented \"", instrumented.filename().u8string(), "\" with the following:\n", gen_string, "\n\n");
+    if (system(gen_string.c_str()) != 0) {
+        print("- Instrumented build failed, aborting.\n");
+        return "";
+    }
+
+    // Train
+    print("- Training \"", instrumented.filename().u8string(), "\".\n");
+    int ret;
+    if (!streq(options.command, "")) {
+        string command = std::regex_replace(options.command, std::regex("\\$PROGRAM"), "\"" + instrumented.u8string() + "\"");
+        ret = system(command.c_str());
+    }
+    else {
+        RunStats stats;
+        ret = run_program(instrumented.u8string(), options.args, stats);
+    }
+    fs::remove(instrumented);
+    if (ret != 0) {
+        print("- Training exited with code ", ret, ", aborting.\n");
+        return "";
+    }
+
+    // Clang writes raw profiles that have to be merged, gcc's .gcda files are used as they are
+    std::vector<string> profiles;
+    for (const auto& p: fs::recursive_directory_iterator(dir)) {
+        if (streq(p.path().extension().u8string(), ".profraw", ".gcda")) profiles.emplace_back(p.path().u8string());
+    }
+    if (profiles.size() == 0) {
+        print("- Training didn't write any profile data, aborting.\n");
+        return "";
+    }
+    if (is_clang(compiler)) {
+        string merge_string = "llvm-profdata merge -output=\"" + profdata.u8string() + "\"";
+        for (const string& profile: profiles) merge_string += " \"" + profile + "\"";
+        if (use_cmd) print("- Merging profiles with the following:\n", merge_string, "\n\n");
+        if (system(merge_string.c_str()) != 0) {
+            print("- Couldn't merge profiles with llvm-profdata, aborting.\n");
+            return "";
+        }
+        for (const string& profile: profiles) fs::remove(profile);
+    }
+
+    std::ofstream pt(stamp, std::ios::trunc);
+    pt << sources;
+    pt.close();
+    return use_flag;
+}
+
+// Settings for "zmake profile"
+struct ProfileOptions {
+    int frequency = 997;        // Samples per second, not a multiple of common timer rates
+    bool sampler = false;       // Link in the SIGPROF sampler instead of using perf
+};
+
+// perf needs perf_event_paranoid <= 2 (or root) for samples, so it's tried once before building for it
+static bool perf_works() {
+    #ifdef __linux__
+    fs::path perf = find_in_path("perf");
+    if (perf.empty()) return false;
+    fs::path data = fs::absolute("build" + FOLDER_NOTATION + "zmake_perf_check.data");
+    RunOptions options;
+    options.output = data.u8string() + ".log";
+    RunStats stats;
+    int ret = run_program(perf.u8string(), { "record", "-q", "-e", "cpu-clock", "-o", data.u8string(), "--", "true" }, stats, options);
+    fs::remove(data);
+    fs::remove(options.output);
+    return ret == 0;
+    #else
+    return false;
+    #endif
+}
+
+// Reads "perf script -F comm,ip,sym" output, a header line with the thread name and then one
+// tab-indented "address symbol" line per frame, leaf first. Stacks are folded root first.
+static void fold_perf_script(const string& script, std::map<string, std::uint64_t>& stacks) {
+    std::istringstream iss(script);
+    string line;
+    string comm = "";
+    std::vector<string> frames;
+    auto fold = [&]() {
+        if (streq(comm, "") && frames.size() == 0) return;
+        string stack = comm;
+        for (auto it = frames.rbegin(); it != frames.rend(); it++) stack += ";" + *it;
+        stacks[stack]++;
+        comm = "";
+        frames.clear();
+    };
+    while (getline(iss, line)) {
+        if (streq(trim(line), "")) fold();
+        else if (line.at(0) == '\t') {
+            line = trim(line);
+            string symbol = line.find(' ') == string::npos ? "[unknown]" : trim(line.substr(line.find(' ') + 1));
+            frames.emplace_back(symbol);
+        }
+        else {
+            fold();
+            comm = trim(line);
+            if (ends_with(comm, ":")) comm = comm.substr(0, comm.length() - 1);
+        }
+    }
+    fold();
+}
+
+// The sampler writes frames it couldn't name as 0xOFFSET@module, static functions aren't in the dynamic
+// symbol table. addr2line finds the program's in its debug info, the rest become [module], since
+// addr2line would just take the closest exported symbol in a stripped system library.
+static void resolve_frames(std::map<string, std::uint64_t>& stacks, const fs::path& program) {
+    const std::regex reg_frame("^(0x[0-9a-f]+)@(.*)$");
+    std::smatch matches;
+    std::map<string, std::vector<string>> modules;     // module -> offsets
+    std::map<string, string> names;                     // frame -> name, [module] until addr2line knows better
+    for (const auto& stack: stacks) {
+        std::istringstream iss(stack.first);
+        string frame;
+        while (getline(iss, frame, ';')) {
+            if (names.count(frame) > 0 || !std::regex_match(frame, matches, reg_frame)) continue;
+            names[frame] = "[" + fs::path(string(matches[2])).filename().u8string() + "]";
+            modules[matches[2]].emplace_back(matches[1]);
+        }
+    }
+    if (modules.size() == 0) return;
+
+    string addr2line = in_path("addr2line") ? "addr2line" : in_path("llvm-addr2line") ? "llvm-addr2line" : "";
+    for (const auto& module: modules) {
+        std::error_code ec;
+        if (streq(addr2line, "") || !fs::equivalent(module.first, program, ec)) continue;
+        // Every address is printed, then a function and file:line pair for it and each function
+        // inlined into it, innermost first. Those become frames of their own, like in perf.
+        for (std::size_t i = 0; i < module.second.size(); i += 256) {
+            string command = addr2line + " -a -f -i -C -e \"" + module.first + "\"";
+            std::size_t end = std::min(module.second.size(), i + 256);
+            for (std::size_t j = i; j < end; j++) command += " " + module.second.at(j);
+            std::istringstream iss(syscall((command + " 2>/dev/null").c_str()));
+            std::size_t j = i - 1;
+            std::vector<string> inlined;
+            string line;
+            string location;
+            auto name = [&]() {
+                if (j < i || j >= end || inlined.size() == 0) return;
+                string frame = "";
+                for (auto it = inlined.rbegin(); it != inlined.rend(); it++) frame += (streq(frame, "") ? "" : ";") + *it;
+                names[module.second.at(j) + "@" + module.first] = frame;
+            };
+            while (getline(iss, line)) {
+                line = trim(line);
+                if (streq(line.substr(0, 2), "0x")) {
+                    name();
+                    j++;
+                    inlined.clear();
+                }
+                else if (getline(iss, location) && !streq(line, "", "??")) inlined.emplace_back(line);
+            }
+            name();
+        }
+    }
+
+    std::map<string, std::uint64_t> resolved;
+    for (const auto& stack: stacks) {
+        std::istringstream iss(stack.first);
+        string frame;
+        string folded = "";
+        while (getline(iss, frame, ';')) {
+            if (names.count(frame) > 0) frame = names.at(frame);
+            folded += (streq(folded, "") ? "" : ";") + frame;
+        }
+        resolved[folded] += stack.second;
+    }
+    stacks = resolved;
+}
+
+static inline string xml_escape(const string& str) {
+    string ret = "";
+    for (char c: str) {
+        if (c == '&') ret += "&amp;";
+        else if (c == '<') ret += "&lt;";
+        else if (c == '>') ret += "&gt;";
+        else if (c == '"') ret += "&quot;";
+        else ret += c;
+    }
+    return ret;
+}
+
+// A frame of the flamegraph and how many samples went through it, children index into the same vector
+struct FlameNode {
+    string name;
+    std::uint64_t samples = 0;
+    std::map<string, std::size_t> children;
+};
+
+static void draw_flame(const std::vector<FlameNode>& nodes, std::size_t index, double x, int depth, int height,
+                       double scale, std::uint64_t total, std::ostringstream& svg) {
+    const FlameNode& node = nodes.at(index);
+    double width = static_cast<double>(node.samples) * scale;
+    if (width < 0.1) return;
+    // Warm colors from the name, so a function keeps its color between runs
+    std::uint64_t hash = fnv1a(node.name);
+    int y = height - 10 - (depth + 1) * 16;
+    double percent = std::round(static_cast<double>(node.samples) * 10000.0 / static_cast<double>(total)) / 100.0;
+    svg << "<g><title>" << xml_escape(node.name) << " (" << node.samples << " samples, " << std::defaultfloat << percent << std::fixed << "%)</title>"
+        << "<rect x=\"" << x << "\" y=\"" << y << "\" width=\"" << width << "\" height=\"15\" rx=\"2\" fill=\"rgb("
+        << 205 + hash % 50 << "," << (hash >> 8) % 230 << "," << (hash >> 16) % 55 << ")\"/>";
+    std::size_t chars = static_cast<std::size_t>((width - 6.0) / 7.0);
+    if (chars >= 3) {
+        string label = node.name.length() <= chars ? node.name : node.name.substr(0, chars - 2) + "..";
+        svg << "<text x=\"" << x + 3.0 << "\" y=\"" << y + 11 << "\">" << xml_escape(label) << "</text>";
+    }
+    svg << "</g>\n";
+    for (const auto& child: node.children) {
+        draw_flame(nodes, child.second, x, depth + 1, height, scale, total, svg);
+        x += static_cast<double>(nodes.at(child.second).samples) * scale;
+    }
+}
+
+// Draws the folded stacks as a self-contained SVG flamegraph, hover a frame to see its samples.
+// The root is at the bottom and the children of a frame are sorted by name, like flamegraph.pl.
+static bool write_flamegraph(const std::map<string, std::uint64_t>& stacks, const fs::path& path, const string& title) {
+    std::vector<FlameNode> nodes(1);
+    nodes.at(0).name = "all";
+    int max_depth = 0;
+    for (const auto& stack: stacks) {
+        std::size_t node = 0;
+        nodes.at(0).samples += stack.second;
+        std::istringstream iss(stack.first);
+        string frame;
+        int depth = 0;
+        while (getline(iss, frame, ';')) {
+            auto child = nodes.at(node).children.find(frame);
+            if (child == nodes.at(node).children.end()) {
+                nodes.emplace_back(FlameNode { frame, 0, {} });
+                child = nodes.at(node).children.emplace(frame, nodes.size() - 1).first;
+            }
+            node = child->second;
+            nodes.at(node).samples += stack.second;
+            max_depth = std::max(max_depth, ++depth);
+        }
+    }
+    if (nodes.at(0).samples == 0) return false;
+
+    const int width = 1200;
+    int height = (max_depth + 1) * 16 + 50;
+    std::ostringstream svg;
+    svg << std::setprecision(4) << std::fixed;
+    svg << "<?xml version=\"1.0\" standalone=\"no\"?>\n";
+    svg << "<svg version=\"1.1\" width=\"" << width << "\" height=\"" << height << "\" viewBox=\"0 0 " << width << " " << height
+        << "\" xmlns=\"http://www.w3.org/2000/svg\">\n";
+    svg << "<style>text { font-family: Verdana, sans-serif; font-size: 12px; fill: #000; } "
+        << "rect:hover { stroke: #000; stroke-width: 0.5; }</style>\n";
+    svg << "<rect x=\"0\" y=\"0\" width=\"" << width << "\" height=\"" << height << "\" fill=\"#f8f8f0\"/>\n";
+    svg << "<text x=\"" << width / 2 << "\" y=\"24\" text-anchor=\"middle\" style=\"font-size: 17px\">" << xml_escape(title) << "</text>\n";
+    draw_flame(nodes, 0, 10.0, 0, height, static_cast<double>(width - 20) / static_cast<double>(nodes.at(0).samples), nodes.at(0).samples, svg);
+    svg << "</svg>\n";
+
+    std::ofstream pt(path, std::ios::trunc);
+    if (!pt.is_open()) return false;
+    pt << svg.str();
+    return true;
+}
+
+// Runs the program under perf record, or with the sampler built in, folds the stacks into
+// build/<name>.folded, draws build/<name>.svg and prints the functions with the most samples
+static int run_profile(const fs::path& path, const std::vector<string>& args, const ProfileOptions& options) {
+    #ifdef _WIN32
+    (void)path;
+    (void)args;
+    (void)options;
+    print("- Profiling isn't supported on Windows, aborting.\n");
+    return EXIT_FAILURE;
+    #else
+    string name = path.filename().u8string();
+    fs::path program = fs::absolute(path);
+    fs::path folded = "build" + FOLDER_NOTATION + name + ".folded";
+    fs::path svg = "build" + FOLDER_NOTATION + name + ".svg";
+    std::map<string, std::uint64_t> stacks;
+    RunStats stats;
+    int ret;
+
+    if (!options.sampler) {
+        // Software clock events work in VMs and containers without hardware counters
+        fs::path data = fs::absolute("build" + FOLDER_NOTATION + name + ".perf.data");
+        std::vector<string> perf_args = { "record", "-q", "-e", "cpu-clock", "-F", std::to_string(options.frequency), "-g",
+                                          "-o", data.u8string(), "--", program.u8string() };
+        for (const string& arg: args) perf_args.emplace_back(arg);
+        print("- Profiling \"", name, "\" with perf at ", options.frequency, " Hz:\n");
+        ret = run_program(find_in_path("perf").u8string(), perf_args, stats);
+        if (ret == -1) {
+            print("- Couldn't run perf, aborting.\n");
+            return EXIT_FAILURE;
+        }
+        fold_perf_script(syscall(("perf script -F comm,ip,sym -i \"" + data.u8string() + "\" 2>/dev/null").c_str()), stacks);
+    }
+    else {
+        fs::path samples = fs::absolute("build" + FOLDER_NOTATION + name + ".samples");
+        fs::remove(samples);
+        setenv("ZMAKE_SAMPLER_OUTPUT", samples.u8string().c_str(), 1);
+        setenv("ZMAKE_SAMPLER_HZ", std::to_string(options.frequency).c_str(), 1);
+        print("- Profiling \"", name, "\" with the built in sampler at ", options.frequency, " Hz:\n");
+        ret = run_program(program.u8string(), args, stats);
+        unsetenv("ZMAKE_SAMPLER_OUTPUT");
+        if (ret == -1) {
+            print("- Couldn't run \"", name, "\", aborting.\n");
+            return EXIT_FAILURE;
+        }
+        // "stack count" lines, "# dropped N" once the sample buffer was full
+        std::istringstream iss(read_file(samples));
+        string line;
+        double value = 0.0;
+        while (getline(iss, line)) {
+            if (streq(line.substr(0, 10), "# dropped ")) {
+                if (to_number(line.substr(10), value) && value > 0.0) print("- The sampler was full, ", value, " samples were dropped.\n");
+                continue;
+            }
+            if (line.find(' ') == string::npos || !to_number(line.substr(line.find_last_of(' ') + 1), value)) continue;
+            stacks[name + ";" + line.substr(0, line.find_last_of(' '))] += static_cast<std::uint64_t>(value);
+        }
+        resolve_frames(stacks, program);
+    }
+    print("\n");
+    if (ret != 0) print("- \"", name, "\" exited with code ", ret, ".\n");
+
+    std::uint64_t total = 0;
+    for (const auto& stack: stacks) total += stack.second;
+    // CPU time timers only fire on the kernel's tick, often 250 Hz
+    double expected = (stats.user_ms + stats.sys_ms) * options.frequency / 1000.0;
+    if (options.sampler && total > 0 && static_cast<double>(total) < expected / 2.0) {
+        print("- Only ", total, " samples in ", stats.user_ms + stats.sys_ms, " ms of CPU time, the kernel's timer tick limits the sampler.\n");
+    }
+    if (total == 0) {
+        print("- No samples were taken, the program has to run for a while, aborting.\n");
+        return EXIT_FAILURE;
+    }
+
+    std::ofstream pt(folded, std::ios::trunc);
+    for (const auto& stack: stacks) pt << stack.first << " " << stack.second << "\n";
+    pt.close();
+    if (!write_flamegraph(stacks, svg, "zmake profile " + name)) {
+        print("- Couldn't write \"", svg.u8string(), "\", aborting.\n");
+        return EXIT_FAILURE;
+    }
+
+    // Self samples are the leaf frames, total counts a function once per stack it is in
+    std::map<string, std::uint64_t> self;
+    std::map<string, std::uint64_t> inclusive;
+    for (const auto& stack: stacks) {
+        std::vector<string> frames;
+        std::istringstream iss(stack.first);
+        string frame;
+        while (getline(iss, frame, ';')) if (!str_is_in_vec(frame, frames)) frames.emplace_back(frame);
+        for (const string& f: frames) inclusive[f] += stack.second;
+        self[stack.first.substr(stack.first.find_last_of(';') + 1)] += stack.second;
+    }
+    std::vector<std::pair<string, std::uint64_t>> hottest(self.begin(), self.end());
+    std::sort(hottest.begin(), hottest.end(), [](const auto& x, const auto& y) { return x.second > y.second; });
+    if (hottest.size() > 10) hottest.resize(10);
+
+    std::ostringstream table;
+    table << std::setprecision(1) << std::fixed;
+    table << "- " << total << " samples, the functions with the most:\n";
+    table << "    self   total  function\n";
+    for (const auto& hot: hottest) {
+        table << std::setw(7) << static_cast<double>(hot.second) * 100.0 / static_cast<double>(total) << "%"
+              << std::setw(7) << static_cast<double>(inclusive[hot.first]) * 100.0 / static_cast<double>(total) << "%  " << hot.first << "\n";
+    }
+    print(table.str());
+    print("- Saved the stacks to \"", folded.u8string(), "\" and the flamegraph to \"", svg.u8string(), "\".\n");
+    return ret;
+    #endif
+}
+
+// The parts of global.hpp in global/include/global, and the names that need them ("rng*" for every name starting with rng).
+// tests/global/tests/modules.zpp checks that every name the headers declare is here.
+static const std::vector<std::pair<string, std::vector<string>>> GLOBAL_MODULES = {
+    { "print", { "print*" } },
+    { "strings", { "streq", "streq_nocase", "strcmp_nocase", "strcount", "strfind", "split", "Split*", "parse", "trim", "trim_view", "timestr" } },
+    { "process", { "syscall" } },
+    { "rng", { "rng*", "Xoshiro256" } },
+    { "alloc", { "Arena", "FixedPool", "Pool" } },
+    { "parallel", { "ThreadPool", "TaskGroup", "thread_pool", "parallel_for", "parallel_reduce" } },
+    { "queue", { "SpscQueue", "MpmcQueue", "BlockingQueue" } },
+    { "bench", { "bench", "bench_compare", "bench_report", "bench_json", "BenchResult", "BenchSettings", "do_not_optimize", "clobber_memory" } },
+    { "io", { "MappedFile", "FileWriter", "split_lines", "LineIterator", "LineRange" } },
+    { "simd", { "Simd*", "SIMD_BACKEND", "GLOBAL_SIMD*", "to_float" } },
+    { "using", { "string", "vector" } },
+};
+
+// The parts of global.hpp that code uses, from the names in it outside of comments and strings.
+// Names after ".", "->" or "a::" are members, so they don't count. Empty if it uses global_detail, which needs all of it.
+static std::vector<string> global_modules_used(const string& code) {
+    std::vector<bool> used(GLOBAL_MODULES.size(), false);
+    auto is_name = [](char c) { return std::isalnum(static_cast<unsigned char>(c)) || c == '_'; };
+    std::size_t i = 0;
+    while (i < code.size()) {
+        char c = code[i];
+        if (c == '/' && i + 1 < code.size() && code[i + 1] == '/') {
+            i = code.find('\n', i);
+        }
+        else if (c == '/' && i + 1 < code.size() && code[i + 1] == '*') {
+            i = code.find("*/", i + 2);
+            if (i != string::npos) i += 2;
+        }
+        else if (c == '"' || c == '\'') {
+            for (i++; i < code.size() && code[i] != c && code[i] != '\n'; i++) {
+                if (code[i] == '\\') i++;
+            }
+            if (i < code.size()) i++;
+        }
+        else if (std::isdigit(static_cast<unsigned char>(c))) {
+            // 1'000'000 and 0x1F'FF have no names or characters in them
+            while (i < code.size() && (is_name(code[i]) || code[i] == '\'' || code[i] == '.')) i++;
+        }
+        else if (is_name(c)) {
+            std::size_t begin = i;
+            while (i < code.size() && is_name(code[i])) i++;
+            string name = code.substr(begin, i - begin);
+            // R"(...)", and with a delimiter: R"end(...)end"
+            if (i < code.size() && code[i] == '"' && name.back() == 'R') {
+                std::size_t open = code.find('(', i);
+                if (open == string::npos) break;
+                string close = ")" + code.substr(i + 1, open - i - 1) + "\"";
+                i = code.find(close, open);
+                if (i != string::npos) i += close.length();
+                continue;
+            }
+            if (streq(name, "global_detail")) return {};
+            std::size_t before = begin;
+            while (before > 0 && std::isspace(static_cast<unsigned char>(code[before - 1]))) before--;
+            if (before > 0 && code[before - 1] == '.') continue;
+            if (before > 1 && code[before - 2] == '-' && code[before - 1] == '>') continue;
+            if (before > 1 && code[before - 2] == ':' && code[before - 1] == ':') {
+                before -= 2;
+                while (before > 0 && std::isspace(static_cast<unsigned char>(code[before - 1]))) before--;
+                if (before > 0 && (is_name(code[before - 1]) || code[before - 1] == '>')) continue;
+            }
+            for (std::size_t m = 0; m < GLOBAL_MODULES.size(); m++) {
+                if (used[m]) continue;
+                for (const string& pattern: GLOBAL_MODULES[m].second) {
+                    if (pattern.back() == '*' ? name.compare(0, pattern.length() - 1, pattern, 0, pattern.length() - 1) == 0
+                                              : name == pattern) {
+                        used[m] = true;
+                        break;
+                    }
+                }
+            }
+        }
+        else i++;
+    }
+    std::vector<string> modules = { "types" };
+    for (std::size_t m = 0; m < GLOBAL_MODULES.size(); m++) {
+        if (used[m]) modules.emplace_back(GLOBAL_MODULES[m].first);
+    }
+    return modules;
+}
+
+// Merges the entry .zpp and every .zpp it includes into one C++ file (main_cpp), with forward
+// declarations of all structs, classes, unions and functions first, so the order doesn't matter.
+// unity_files are #included as well. With global_modules, #include "global.hpp" becomes the parts of it
+// the code and the headers in header_dirs (the merged project's) use. Returns false if a file can't be found.
+static bool merge_zpp(const std::vector<fs::path>& entries, const std::vector<fs::path>& zfiles_inclist,
+                      const std::vector<string>& unity_files, const std::vector<fs::path>& header_dirs,
+                      bool global_modules, string& main_cpp) {
+    std::ifstream qt;
+    string read_line;
+    string read_line_next;
+    bool read_line_loop = false;
+    std::smatch matches;
+    std::vector<fs::path> zfiles = entries;
+
+    const std::regex reg_string_start("(.*)R\"\\((.*)");
+    const std::regex reg_string_end("(.*)\\)\"(.*)");
+    const std::regex reg_comment_start("(.*)/\\*(.*)");
+    const std::regex reg_comment_end("(.*)\\*/(.*)");
+    const std::regex reg_comment_one_line("^(\\s*)//(.*)");
+    const std::regex reg_second_line_bracket("^(\\s*)\\{(.*)");
+    bool in_string = false;
+    bool in_comment = false;
+
+    // 2D vector to store includes along with which files included them to show in *_zmake.cpp
+    std::vector<std::vector<string>> include_list;
+    include_list.reserve(8);
+    const std::regex reg_include("^#include (<(.*?)>|\"(.*)\")(.*)");
+
+    // Forward declarations (reg functions varför funkar du inte)
+    const std::regex reg_structs("^(struct|class|union) (\\S+)\\s*\\{(.*)");
+    const std::regex reg_functions("^((\\S+\\s+)+?)(\\S+)\\((.*)\\)\\s*\\{(.*)"); //[1] type, [2] fcn_name, [3] args.
+    const std::regex reg_template("^template(\\s*)<(.*?)>(.*)");
+    const std::regex reg_args("(.*?)=(.*?),(.*)");
+    const std::regex reg_args_end("(.*?)=(.*)");
+    std::vector<string> forward_structs;
+    std::vector<string> forward_functions;
+    forward_structs.reserve(8);
+    forward_functions.reserve(64);
+    string template_fcn = "";
+
+    bool added_structs = false;
+    bool added_functions = false;
+    string add_structs = "";
+    string add_functions = "";
+
+    // Get includes, and structs, classes, unions and functions
+    // so we can forward declare them, in that order.
+    for (unsigned int i = 0; i < zfiles.size(); i++) {
+        qt.open(zfiles.at(i));
+        if (!qt.is_open()) {
+            print("- Couldn't open file \"", zfiles.at(i), "\", aborting.\n");
+            return false;
+        }
+        // Annotate where structs and functions come from, removed at end if not filled
+        added_structs = false;
+        added_functions = false;
+        add_structs = "// From " + zfiles.at(i).u8string() + "\n";
+        add_functions = "// From " + zfiles.at(i).u8string() + "\n";
+
+        while (getline(qt, read_line)) {
+            forward_declare:
+            if (in_string) {
+                if (std::regex_match(read_line, matches, reg_string_end)) {
+                    in_string = false;
+                    read_line = matches[2];
+                    goto forward_declare;
+                }
+            }
+            else if (in_comment) {
+                if (std::regex_match(read_line, matches, reg_comment_end)) {
+                    in_comment = false;
+                    read_line = matches[2];
+                    goto forward_declare;
+                }
+            }
+            else if (std::regex_match(read_line, matches, reg_comment_one_line)) {
+                continue;
+            }
+            else {
+                if (std::regex_match(read_line, matches, reg_string_start) && !in_comment) {
+                    if (in_string) continue;
+                    else {
+                        in_string = true;
+                        goto forward_declare;
+                    }
+                }
+                if (std::regex_match(read_line, matches, reg_comment_start) && !in_string) {
+                    if (in_comment) continue;
+                    else {
+                        in_comment = true;
+                        goto forward_declare;
+                    }
+                }
+                // Get { on second line, put this after comment and strings
+                if (getline(qt, read_line_next)) {
+                    read_line_loop = true;
+                    if (std::regex_match(read_line_next, matches, reg_second_line_bracket)) {
+                        read_line = trim(read_line) + trim(read_line_next);
+                    }
+                }
+                if (std::regex_match(read_line, matches, reg_include)) {
+                    bool include_already_exists = false;
+                    string incfile = matches[1];
+                    string zpp_file_inc = incfile.substr(1, incfile.length() - 2);
+                    // Including a .zpp file
+                    if (ends_with(zpp_file_inc, ".zpp") || ends_with(zpp_file_inc, ".z")) {
+                        for (unsigned int j = 0; j < zfiles_inclist.size(); j++) {
+                            if (streq(zfiles_inclist.at(j).filename().u8string(), zpp_file_inc)) {
+                                if (!str_is_in_vec(zfiles_inclist.at(j).u8string(), zfiles)) {
+                                    zfiles.emplace_back(zfiles_inclist.at(j));
+                                }
+                                incfile = "//#include \"" + zpp_file_inc + "\"";
+                                goto add_include;
+                            }
+                        }
+                        print("- Couldn't find file \"", zpp_file_inc, "\", aborting.\n");
+                        return false;
+                    }
+                    else incfile = "#include " + incfile;
+                    add_include:
+                    for (unsigned int j = 0; j < include_list.size(); j++) {
+                        if (streq(incfile, include_list.at(j).at(0))) {
+                            include_already_exists = true;
+                            include_list.at(j).emplace_back(zfiles.at(i).u8string());
+                            break;
+                        }
+                    }
+                    if (!include_already_exists) {
+                        include_list.emplace_back(std::vector<string> { incfile, zfiles.at(i).u8string() });
+                    }
+                }
+                else if (std::regex_match(read_line, matches, reg_structs)) {
+                    string temp_struct = matches[1];
+                    temp_struct += " ";
+                    temp_struct += matches[2];
+                    temp_struct += ";\n";
+                    add_structs += temp_struct;
+                    added_structs = true;
+                }
+                else if (std::regex_match(read_line, matches, reg_functions)) {
+                    if (streq("main", matches[3])) continue;
+                    string temp_fcn = template_fcn;
+                    temp_fcn += matches[1];
+                    temp_fcn += matches[3];
+                    temp_fcn += "(";
+                    string temp_args = matches[4];
+                    while (std::regex_match(temp_args, matches, reg_args)) {
+                        temp_args = trim(matches[1]);
+                        temp_args += ", ";
+                        temp_args += trim(matches[3]);
+                    }
+                    if (std::regex_match(temp_args, matches, reg_args_end)) {
+                        temp_args = trim(matches[1]);
+                    }
+                    temp_fcn += temp_args;
+                    temp_fcn += ");\n";
+                    add_functions += temp_fcn;
+                    added_functions = true;
+                }
+                else if (std::regex_match(read_line, matches, reg_template)) {
+                    template_fcn = "template <" + string(matches[2]) + ">\n";
+                }
+                else {
+                    template_fcn = "";
+                }
+                if (read_line_loop) {
+                    read_line = read_line_next;
+                    read_line_loop = false;
+                    goto forward_declare;
+                }
+            }
+        }
+        // If a file doesn't add any new structs/functions, remove it from *_zmake.cpp.
+        if (added_structs) forward_structs.emplace_back(add_structs);
+        if (added_functions) forward_functions.emplace_back(add_functions);
+
+        qt.close();
+        in_string = false;
+        in_comment = false;
+        read_line_loop = false;
+    }
+    bool empty_start_lines = true;
+
+    // Add rest of code to *_zmake.cpp
+    std::vector<string> forward_zcode;
+    forward_zcode.reserve(16);
+    string zfile_code = "";
+
+    for (unsigned int i = 0; i < zfiles.size(); i++) {
+        qt.open(zfiles.at(i));
+        if (!qt.is_open()) {
+            print("- Couldn't open file \"", zfiles.at(i), "\", aborting.\n");
+            return false;
+        }
+        zfile_code = string("\n// From ") + zfiles.at(i).u8string() + string("\n");
+        empty_start_lines = true;
+        // Just dont add includes
+        while (getline(qt, read_line)) {
+            if (in_string) {
+                if (std::regex_match(read_line, matches, reg_string_end)) {
+                    in_string = false;
+                }
+            }
+            else if (in_comment) {
+                if (std::regex_match(read_line, matches, reg_comment_end)) {
+                    in_comment = false;
+                }
+            }
+            else {
+                if (std::regex_match(read_line, matches, reg_string_start) && !in_comment) {
+                    in_string = true;
+                }
+                else if (std::regex_match(read_line, matches, reg_comment_start) && !in_string) {
+                    in_comment = true;
+                }
+                else if (std::regex_match(read_line, matches, reg_include)) {
+                    continue;
+                }
+            }
+            if (empty_start_lines && streq(read_line, "")) continue;
+            else empty_start_lines = false;
+            zfile_code += read_line;
+            zfile_code += "\n";
+        }
+        forward_zcode.emplace_back(zfile_code);
+        qt.close();
+        in_string = false;
+        in_comment = false;
+    }
+
+    // Only the parts of global.hpp the code uses, which compile faster than all of it.
+    // The headers in header_dirs (the project's /include and /src) can use it without including it, so they count too,
+    // and if the code includes a header from somewhere else with "", all of global.hpp is kept.
+    if (global_modules) {
+        for (std::size_t i = 0; i < include_list.size(); i++) {
+            if (!streq(include_list[i][0], "#include \"global.hpp\"", "#include <global.hpp>")) continue;
+            string code = "";
+            for (const string& zcode: forward_zcode) code += zcode;
+            std::vector<string> includes;
+            for (const std::vector<string>& include: include_list) includes.emplace_back(include[0]);
+            for (const string& unity_file: unity_files) {
+                string unity_code = read_file(unity_file);
+                for (std::size_t at = unity_code.find("#include \""); at != string::npos; at = unity_code.find("#include \"", at + 1)) {
+                    includes.emplace_back(unity_code.substr(at, unity_code.find('"', at + 10) + 1 - at));
+                }
+                code += unity_code;
+            }
+            std::vector<string> headers;
+            for (const fs::path& dir: header_dirs) {
+                if (!fs::is_directory(dir)) continue;
+                for (const auto& p: fs::recursive_directory_iterator(dir)) {
+                    if (!streq(p.path().extension().u8string(), ".h", ".hh", ".hpp", ".hxx", ".inl")) continue;
+                    if (is_in_directory(p.path(), dir / "build")) continue;
+                    code += read_file(p.path());
+                    headers.emplace_back(p.path().filename().u8string());
+                }
+            }
+            bool other_header = false;
+            for (const string& include: includes) {
+                if (include.compare(0, 10, "#include \"") != 0 || include.back() != '"') continue;
+                string header = include.substr(10, include.length() - 11);
+                if (streq(header, "global.hpp") || header.compare(0, 7, "global/") == 0) continue;
+                if (!str_is_in_vec(fs::path(header).filename().u8string(), headers)) other_header = true;
+            }
+            if (other_header) break;
+            std::vector<string> modules = global_modules_used(code);
+            if (modules.size() == 0) break;
+            std::vector<string> included_from(include_list[i].begin() + 1, include_list[i].end());
+            include_list.erase(include_list.begin() + static_cast<std::ptrdiff_t>(i));
+            for (std::size_t m = 0; m < modules.size(); m++) {
+                std::vector<string> module_include = { "#include \"global/" + modules[m] + ".hpp\"" };
+                module_include.insert(module_include.end(), included_from.begin(), included_from.end());
+                include_list.insert(include_list.begin() + static_cast<std::ptrdiff_t>(i + m), module_include);
+            }
+            break;
+        }
+    }
+
+    // Fix main.cpp
+    main_cpp = "//// This file was automatically generated by\n//// "
+                         + ZMAKE_VERSION + ", at " + timestr() + ".\n";
+    if (include_list.size() != 0) main_cpp += "\n//// Includes\n";
+    for (unsigned int i = 0; i < include_list.size(); i++) {
+        main_cpp += include_list.at(i).at(0);
+        // Add soft tabs
+        int tabsize = static_cast<int>(include_list.at(i).at(0).length());
+        tabsize = 4 - (tabsize % 4);
+        for (int j = 0; j < tabsize; j++) main_cpp += " ";
+
+        main_cpp += "// From ";
+        for (unsigned int j = 1; j < include_list.at(i).size(); j++) {
+            if (j > 1) main_cpp += ", ";
+            main_cpp += include_list.at(i).at(j);
+        }
+        main_cpp += "\n";
+    }
+
+
+
+    if (unity_files.size() > 0) {
+        main_cpp += "\n//// Unity includes\n";
+        for (unsigned int i = 0; i < unity_files.size(); i++) {
+            main_cpp += "#include \"" + unity_files.at(i) + "\"\n";
+        }
+    }
+    if (forward_structs.size() > 0) {
+        main_cpp += "\n//// Structs, classes and unions\n";
+        for (unsigned int i = 1; i < forward_structs.size(); i++) {
+            main_cpp += forward_structs.at(i);
+            main_cpp += "\n";
+        }
+        main_cpp += forward_structs.at(0);
+    }
+    if (forward_functions.size() > 0) {
+        main_cpp += "\n//// Functions\n";
+        for (unsigned int i = 1; i < forward_functions.size(); i++) {
+            main_cpp += forward_functions.at(i);
+            main_cpp += "\n";
+        }
+        main_cpp += forward_functions.at(0);
+    }
+    if (forward_zcode.size() > 0) {
+        main_cpp += "\n//// Code";
+        for (unsigned int i = 1; i < forward_zcode.size(); i++) {
+            main_cpp += forward_zcode.at(i);
+        }
+        main_cpp += forward_zcode.at(0);
+    }
+    return true;
+}
+
+// Builds the libraries into build/lib/<profile>, skipping those whose fingerprint (every file in the
+// library and the compile command) is the same as last time. compile_prefix ends right before an
+// output name. The files to link executables with are added to link_files.
+static bool build_libraries(const std::vector<Library>& libraries, const string& compiler, const string& compile_prefix,
+                            const string& profile, unsigned int jobs_num, bool use_cmd, bool global_modules, string& link_files) {
+    fs::path lib_dir = fs::absolute("build" + FOLDER_NOTATION + "lib" + FOLDER_NOTATION + profile);
+    fs::create_directories(lib_dir);
+    string obj_ext = ends_with(compiler, "cl") ? ".obj" : ".o";
+    std::vector<Job> jobs;
+    std::vector<std::pair<fs::path, string>> fingerprints;
+
+    for (const Library& library: libraries) {
+        fs::path sources = library_sources(library);
+        fs::path output;
+        #ifdef __APPLE__
+        string shared_ext = ".dylib";
+        string rpath = "@loader_path/lib/" + profile;
+        #else
+        string shared_ext = ".so";
+        string rpath = "'$ORIGIN/lib/" + profile + "'";
+        #endif
+        if (ON_WINDOWS) output = lib_dir / (library.name + ".lib");
+        else output = lib_dir / ("lib" + library.name + (library.shared ? shared_ext : ".a"));
+        link_files += " \"" + output.u8string() + "\"";
+        // Executables are in /build, so they find shared libraries relative to themselves
+        if (library.shared) link_files += " -Wl,-rpath," + rpath;
+
+        // Fingerprint everything in the library, headers included
+        std::vector<fs::path> files;
+        for (const auto& p: fs::recursive_directory_iterator(library.path)) {
+            if (fs::is_directory(p.path()) || is_in_directory(p.path(), library.path / "build")) continue;
+            files.emplace_back(p.path());
+        }
+        std::sort(files.begin(), files.end());
+        std::uint64_t hash = fnv1a(compile_prefix + (library.shared ? " shared" : " static") + (global_modules ? " global_modules" : ""));
+        for (const fs::path& file: files) {
+            hash = fnv1a(file.u8string(), hash);
+            hash = fnv1a(read_file(file), hash);
+        }
+        fs::path fingerprint = lib_dir / (library.name + ".fingerprint");
+        if (fs::exists(output) && streq(read_file(fingerprint), to_hex(hash))) {
+            print("- Library \"", library.name, "\" is up to date.\n");
+            continue;
+        }
+        fingerprints.emplace_back(fingerprint, to_hex(hash));
+        fs::remove(output);
+        fs::remove(fingerprint);
+
+        // The .zpp files of a library are merged into one file, it has no entry point
+        std::vector<string> files_to_compile;
+        std::vector<fs::path> zfiles;
+        for (const fs::path& file: files) {
+            if (!is_in_directory(file, sources)) continue;
+            if (streq(file.extension().u8string(), ".c", ".cpp", ".cc", ".c++", ".cxx")) files_to_compile.emplace_back(fs::absolute(file).u8string());
+            else if (streq(file.extension().u8string(), ".z", ".zpp")) zfiles.emplace_back(file);
+        }
+        if (zfiles.size() > 0) {
+            string main_cpp = "";
+            // A zmake project's headers are in /include and /src, a folder's anywhere in it
+            std::vector<fs::path> header_dirs = { library.path };
+            if (fs::exists(library.path / "zmake.cfg")) header_dirs = { library.path / "include", library.path / "src" };
+            if (!merge_zpp(zfiles, zfiles, {}, header_dirs, global_modules, main_cpp)) return false;
+            fs::path merged = lib_dir / (library.name + "_zmake.cpp");
+            std::ofstream pt(merged, std::ios::trunc);
+            pt << main_cpp;
+            pt.close();
+            files_to_compile.emplace_back(merged.u8string());
+        }
+        if (files_to_compile.size() == 0) {
+            print("- Library \"", library.name, "\" has no source files, aborting.\n");
+            return false;
+        }
+
+        fs::path obj_dir = lib_dir / library.name;
+        fs::create_directories(obj_dir);
+        std::size_t first = jobs.size();
+        string objects = "";
+        for (const string& file: files_to_compile) {
+            fs::path object = obj_dir / (fs::path(file).stem().u8string() + "_" + to_hex(fnv1a(file)).substr(0, 8) + obj_ext);
+            objects += " \"" + object.u8string() + "\"";
+            string pic = library.shared ? " -fPIC" : "";
+            jobs.emplace_back(object_job(fs::path(file).filename().u8string(), compiler + pic + compile_prefix.substr(compiler.length()), file, object));
+        }
+        Job archive { library.name, "", {}, -1 };
+        if (library.shared) {
+            #ifdef __APPLE__
+            string soname = " -dynamiclib -Wl,-install_name,@rpath/lib" + library.name + shared_ext;
+            #else
+            string soname = " -shared -Wl,-soname,lib" + library.name + shared_ext;
+            #endif
+            archive.command = compiler + soname + objects +
+                              compile_prefix.substr(compiler.length()) + " \"" + output.u8string() + "\"";
+        }
+        else if (ends_with(compiler, "cl")) archive.command = (streq(compiler, "clang-cl") ? "llvm-lib" : "lib") + string(" -nologo -out:\"") + output.u8string() + "\"" + objects;
+        else archive.command = "ar rcs \"" + output.u8string() + "\"" + objects;
+        for (std::size_t i = first; i < jobs.size(); i++) archive.deps.emplace_back(i);
+        jobs.emplace_back(archive);
+    }
+    if (jobs.size() == 0) return true;
+
+    if (use_cmd) print("- Compiling ", fingerprints.size(), " libraries with ", jobs_num, " jobs:\n");
+    bool success = run_jobs(jobs, jobs_num, use_cmd);
+    if (use_cmd) print("\n");
+    if (!success) return false;
+    for (const auto& fingerprint: fingerprints) {
+        std::ofstream pt(fingerprint.first, std::ios::trunc);
+        pt << fingerprint.second;
+    }
+    return true;
+}
+
+// A [member.name] section in zmake.workspace, a zmake project built after the members it depends on
+struct Member {
+    string name;
+    fs::path path;
+    std::vector<string> depends;
+};
+
+// Path of the running zmake, so members are built by the same version
+static string self_path(const char* argv0) {
+    #ifdef __linux__
+    std::error_code ec;
+    fs::path exe = fs::read_symlink("/proc/self/exe", ec);
+    if (!ec) return exe.u8string();
+    #endif
+    string path = argv0;
+    if (path.find_first_of("/\\") == string::npos) return path;     // Found in PATH
+    return fs::absolute(path).u8string();
+}
+
+// Builds every member of the workspace in the current directory with "zmake build" (or "zmake test"), starting each
+// member as soon as the members it depends on are done. All members take their compiler jobs from
+// one shared pool, so jobs_num limits the compilers running across the whole workspace.
+static int build_workspace(const string& zmake_path, bool use_test, const string& build_profile, const std::vector<string>& commands) {
+    std::ifstream ws("zmake.workspace");
+    if (!ws.is_open()) {
+        print("- Couldn't open zmake.workspace, aborting.\n");
+        return EXIT_FAILURE;
+    }
+    const std::regex reg_profile("^\\[(.*)\\](.*)");
+    const std::regex reg_flag("^(.*?)(\\s)*=(\\s)*\"(.*)\"(.*)");
+    std::smatch matches;
+    string line;
+    string current_profile = "";
+    std::vector<Member> members;
+    unsigned int jobs_num = std::max(1U, std::thread::hardware_concurrency());
+    while (getline(ws, line)) {
+        if (std::regex_match(line, matches, reg_profile)) {
+            current_profile = matches[1];
+            if (streq(current_profile.substr(0, 7), "member.")) {
+                string name = current_profile.substr(7);
+                members.emplace_back(Member { name, name, {} });
+            }
+            continue;
+        }
+        if (!std::regex_match(line, matches, reg_flag)) continue;
+        string current_flag = matches[1];
+        if (streq(current_profile, "workspace") && streq(current_flag, "jobs")) {
+            double value = 0.0;
+            if (to_number(matches[4], value) && value >= 1.0) jobs_num = static_cast<unsigned int>(value);
+        }
+        else if (streq(current_profile.substr(0, 7), "member.")) {
+            if (streq(current_flag, "path")) {
+                string in = matches[4];
+                change_folder_notation(in);
+                members.back().path = in;
+            }
+            else if (streq(current_flag, "depends")) members.back().depends = split_args(matches[4]);
+        }
+    }
+    ws.close();
+
+    // Everything but -j goes on to the members, which only build (or build and run their tests)
+    bool use_time = true;
+    string member_flags = (use_test ? " test -" : " build -") + build_profile;
+    for (const string& command: commands) {
+        if (streq(command.substr(0, 2), "-j", "/j") && command.length() > 2) {
+            double value = 0.0;
+            string arg = command.substr(2);
+            if (streq(arg.substr(0, 1), "=")) arg = arg.substr(1);
+            if (!to_number(arg, value) || value < 1.0) {
+                print("- Invalid number of jobs \"", command, "\", aborting.\n");
+                return EXIT_FAILURE;
+            }
+            jobs_num = static_cast<unsigned int>(value);
+            continue;
+        }
+        if (streq(command, "-notime", "/notime")) use_time = false;
+        if (command.find(' ') != string::npos) member_flags += " \"" + command + "\"";
+        else member_flags += " " + command;
+    }
+    if (!use_test) member_flags += " -norun";
+
+    if (members.size() == 0) {
+        print("- No members in zmake.workspace, aborting.\n");
+        return EXIT_FAILURE;
+    }
+    std::vector<Job> jobs;
+    for (const Member& member: members) {
+        for (const Job& job: jobs) {
+            if (streq(job.name, member.name)) {
+                print("- Member \"", member.name, "\" is listed twice, aborting.\n");
+                return EXIT_FAILURE;
+            }
+        }
+        if (!fs::exists(member.path / "zmake.cfg")) {
+            print("- Member \"", member.name, "\" at \"", member.path.u8string(), "\" is not a zmake directory, aborting.\n");
+            return EXIT_FAILURE;
+        }
+        string cd = ON_WINDOWS ? "cd /d \"" : "cd \"";
+        jobs.emplace_back(Job { member.name, cd + fs::absolute(member.path).u8string() + "\" && \"" + zmake_path + "\"" + member_flags, {}, -1, false });
+    }
+    for (std::size_t i = 0; i < members.size(); i++) {
+        for (const string& dep: members.at(i).depends) {
+            std::size_t j = 0;
+            while (j < members.size() && !streq(members.at(j).name, dep)) j++;
+            if (j == members.size()) {
+                print("- Member \"", members.at(i).name, "\" depends on unknown member \"", dep, "\", aborting.\n");
+                return EXIT_FAILURE;
+            }
+            jobs.at(i).deps.emplace_back(j);
+        }
+    }
+    // run_jobs() would wait forever on a cycle, so check that every member can be ordered
+    std::vector<bool> ordered(members.size(), false);
+    for (std::size_t done = 0, last = 1; done < members.size() && last != 0; done += last) {
+        last = 0;
+        for (std::size_t i = 0; i < members.size(); i++) {
+            if (ordered.at(i)) continue;
+            bool ready = true;
+            for (std::size_t dep: jobs.at(i).deps) if (!ordered.at(dep)) ready = false;
+            if (ready) {
+                ordered.at(i) = true;
+                last++;
+            }
+        }
+    }
+    for (std::size_t i = 0; i < members.size(); i++) {
+        if (!ordered.at(i)) {
+            print("- Member \"", members.at(i).name, "\" is part of a dependency cycle, aborting.\n");
+            return EXIT_FAILURE;
+        }
+    }
+
+    // A nested workspace keeps using the pool of the outer one
+    jobserver_create(jobs_num);
+    print("- Building ", members.size(), " members with ", jobs_num, " jobs.\n");
+    auto a = std::chrono::steady_clock::now();
+    bool success = run_jobs(jobs, static_cast<unsigned int>(members.size()), false);
+    std::chrono::duration<double, std::milli> fp_workspace = std::chrono::steady_clock::now() - a;
+
+    for (const Job& job: jobs) if (job.status == -1) print("- Skipped \"", job.name, "\" since a dependency failed.\n");
+    if (use_time) print("- Workspace took ", fp_workspace.count(), " ms.\n");
+    if (!success) {
+        print("- Workspace build failed, aborting.\n");
+        return EXIT_FAILURE;
+    }
+    print("- Built ", members.size(), " members.\n");
+    return EXIT_SUCCESS;
 }
 
-// If string is equal to ANY of the others
-template <typename... Args>
-static inline bool streq(const string& str, Args&&... args) {
-    return ((str.compare(std::forward<Args>(args)) == 0) || ...);
-}
+// One combination of settings tried by "zmake tune"
+struct TuneCandidate {
+    string compiler;
+    string optimization;
+    string march;           // "" for none
+    string flags;
+    string lto;
+    bool unity = true;
+    double median = -1.0;   // -1 if it didn't build or run
+};
 
-// Removes whitespace from both ends
-static inline string trim(string str) {
-    str.erase(str.begin(), std::find_if(str.begin(), str.end(), [](int ch) { return !std::isspace(ch); }));
-    str.erase(std::find_if(str.rbegin(), str.rend(), [](int ch) { return !std::isspace(ch); }).base(), str.end());
-    return str;
-}
+// Builds the program with every combination of the settings in [tune] and benchmarks each one,
+// then writes the fastest to [profile.tuned] in zmake.cfg and the table to build/<name>_tune.json.
+// extra_flags are passed to every build.
+static int run_tune(const string& zmake_path, const BenchOptions& bench, const std::vector<string>& args, const std::vector<string>& extra_flags) {
+    auto list = [](const string& key, const string& fallback) {
+        string value = config_value("tune", key, fallback);
+        std::replace(value.begin(), value.end(), ',', ' ');
+        std::vector<string> values = split_args(value);
+        if (values.size() == 0) values.emplace_back("");
+        return values;
+    };
+    std::vector<string> compilers = list("compilers", config_value("profile.release", "compiler", DEFAULT_COMPILER));
+    std::vector<string> optimizations = list("optimizations", ON_WINDOWS ? "-O2" : "-O2 -O3");
+    std::vector<string> marchs = list("march", "none native");
+    std::vector<string> ltos = list("lto", "off");
+    std::vector<string> unitys = list("unity", "on");
+    std::vector<string> toggles = split_args(config_value("tune", "flags"));   // Each one tried on and off
 
-static inline bool ends_with(const string& str, const string& suffix) {
-    if (suffix.size() > str.size()) return false;
-    return std::equal(suffix.rbegin(), suffix.rend(), str.rbegin());
-}
+    std::vector<TuneCandidate> candidates;
+    for (string compiler: compilers) {
+        if (streq(compiler.substr(0, 1), "-", "/")) compiler = compiler.substr(1);
+        if (streq(compiler, "msvc")) compiler = "cl";
+        if (!streq(compiler, "gcc", "g++", "clang", "clang++", "clang-cl", "cl")) {
+            print("- Can't tune with compiler \"", compiler, "\", use gcc, g++, clang, clang++, clang-cl or cl, aborting.\n");
+            return EXIT_FAILURE;
+        }
+        if (!in_path(compiler)) {
+            print("- Compiler \"", compiler, "\" isn't installed, skipping it.\n");
+            continue;
+        }
+        for (const string& optimization: optimizations)
+        for (const string& march: marchs)
+        for (const string& lto: ltos)
+        for (const string& unity: unitys)
+        for (std::size_t mask = 0; mask < (std::size_t(1) << toggles.size()); mask++) {
+            TuneCandidate candidate;
+            candidate.compiler = compiler;
+            candidate.optimization = optimization;
+            candidate.march = streq(march, "none", "off") ? "" : march;
+            candidate.lto = streq(lto, "") ? "off" : lto;
+            candidate.unity = !streq(unity, "off", "false", "no");
+            for (std::size_t i = 0; i < toggles.size(); i++) {
+                if ((mask >> i) & 1) candidate.flags += (streq(candidate.flags, "") ? "" : " ") + toggles.at(i);
+            }
+            candidates.emplace_back(candidate);
+        }
+    }
+    if (candidates.size() == 0) {
+        print("- Nothing to tune, aborting.\n");
+        return EXIT_FAILURE;
+    }
 
-static inline string timestr(const std::time_t& time = std::time(nullptr), const char* const format = "%Y-%m-%d %H:%M:%S") {
-    #ifdef _WIN32
-    std::tm tb;
-    localtime_s(&tb, &time);
-    char mbstr[64];
-    std::strftime(mbstr, sizeof(mbstr), format, &tb);
-    #else
-    std::tm *tb;
-    tb = localtime(&time);
-    char mbstr[64];
-    std::strftime(mbstr, sizeof(mbstr), format, tb);
-    #endif
-    return string(mbstr);
-}
+    string name = config_value("package", "name", fs::current_path().stem().u8string());
+    fs::path program = "build" + FOLDER_NOTATION + name + "_custom" + (ON_WINDOWS ? ".exe" : "");
+    string extra = "";
+    for (const string& flag: extra_flags) extra += " " + flag;
+    print("- Tuning ", candidates.size(), " combinations with ", bench.warmup, " warmup and ", bench.runs, " timed runs each.\n");
 
-// Returns the result of system() call, _popen for Windows compatibility
-static inline string syscall(const char* const cmd) {
-    string ret = "";
-    FILE* fpipe;
-    #ifdef _WIN32
-    fpipe = _popen(cmd, "r");
-    #else
-    fpipe = popen(cmd, "r");
-    #endif
-    if (fpipe == nullptr) return ret;
-    char c;
-    while (fread(&c, sizeof(c), 1, fpipe)) ret += c;
-    #ifdef _WIN32
-    _pclose(fpipe);
-    #else
-    pclose(fpipe);
-    #endif
-    return ret;
-}
+    for (std::size_t i = 0; i < candidates.size(); i++) {
+        TuneCandidate& c = candidates.at(i);
+        string description = c.compiler + " " + c.optimization + (streq(c.march, "") ? "" : " -march=" + c.march) +
+                             (streq(c.flags, "") ? "" : " " + c.flags) + " lto=" + c.lto + (c.unity ? "" : " nounity");
+        print("- [", i + 1, "/", candidates.size(), "] ", description, ": ");
+        // Building with a compiler flag always goes to the "custom" profile
+        string command = "\"" + zmake_path + "\" build -" + c.compiler + " " + c.optimization +
+                         (streq(c.march, "") ? "" : " -march=" + c.march) + (streq(c.flags, "") ? "" : " " + c.flags) +
+                         " -lto=" + c.lto + (c.unity ? "" : " -nounity") + extra + " -nocmd -notime";
+        fs::remove(program);
+        RunStats stats;
+        if (run_command(command, stats) != 0 || !fs::exists(program)) {
+            print("build failed.\n");
+            continue;
+        }
+        std::vector<double> samples;
+        long max_rss_kb = 0;
+        if (!bench_samples(program, args, bench, samples, max_rss_kb)) continue;
+        std::sort(samples.begin(), samples.end());
+        c.median = median_of(samples);
+        print(c.median, " ms.\n");
+    }
 
-// Keeps asking the user for input until he answers yes or no
-static inline bool get_yes_or_no() {
-    string input;
-    get_the_input:
-    std::cout << "- " << std::flush;
-    getline(std::cin, input);
-    transform(input.begin(), input.end(), input.begin(), [](unsigned char c){ return toupper(c); });
-    if (input == "YES" || input == "Y" || input == "JA" || input == "J") return true;
-    else if (input == "NO" || input == "N" || input == "NEJ") {
-        std::cout << "- Exiting." << std::endl;
-        return false;
+    std::vector<TuneCandidate> ranked;
+    for (const TuneCandidate& c: candidates) if (c.median >= 0.0) ranked.emplace_back(c);
+    if (ranked.size() == 0) {
+        print("- No combination could be built and run, aborting.\n");
+        return EXIT_FAILURE;
     }
-    else goto get_the_input;
-}
+    std::stable_sort(ranked.begin(), ranked.end(), [](const TuneCandidate& x, const TuneCandidate& y) { return x.median < y.median; });
 
-// Resets defaultconfig.cfg
-static inline bool reset_default_config() {
-    const char* const filename = "defaultconfig.cfg";
-    if (!fs::exists(ZMAKE_ROOT + FOLDER_NOTATION + "global" + FOLDER_NOTATION + filename)) {
-        std::ofstream pt;
-        std::cout << "- \"" << filename << "\" missing in " << ZMAKE_ROOT << FOLDER_NOTATION << "global." << std::endl;
-        std::cout << "- Do you want to restore the default? [y/n]" << std::endl;
-        if (!get_yes_or_no()) return false;
-        std::cout << "- Restoring \"" << filename << "\"." << std::endl;
-        pt.open(ZMAKE_ROOT + FOLDER_NOTATION + "global" + FOLDER_NOTATION + filename, std::ios::trunc);
-        pt << DEFAULT_CFG;
-        pt.close();
+    std::ostringstream table;
+    std::ostringstream json;
+    table << std::fixed << std::setprecision(3);
+    json << std::fixed << std::setprecision(6);
+    table << "\n    " << std::left << std::setw(6) << "rank" << std::setw(12) << "median ms" << std::setw(10) << "vs best"
+          << std::setw(10) << "compiler" << std::setw(8) << "opt" << std::setw(12) << "march" << std::setw(6) << "lto"
+          << std::setw(7) << "unity" << "flags\n";
+    json << "{\n    \"program\": \"" << name << "\",\n    \"date\": \"" << timestr() << "\",\n    \"runs\": " << bench.runs << ",\n    \"results\": [\n";
+    for (std::size_t i = 0; i < ranked.size(); i++) {
+        const TuneCandidate& c = ranked.at(i);
+        std::ostringstream ratio;
+        ratio << std::fixed << std::setprecision(2) << c.median / ranked.front().median << "x";
+        table << "    " << std::left << std::setw(6) << i + 1 << std::setw(12) << c.median << std::setw(10) << ratio.str()
+              << std::setw(10) << c.compiler << std::setw(8) << c.optimization << std::setw(12) << (streq(c.march, "") ? "-" : c.march)
+              << std::setw(6) << c.lto << std::setw(7) << (c.unity ? "on" : "off") << c.flags << "\n";
+        json << "        { \"compiler\": \"" << c.compiler << "\", \"optimization\": \"" << c.optimization << "\", \"march\": \"" << c.march
+             << "\", \"flags\": \"" << c.flags << "\", \"lto\": \"" << c.lto << "\", \"unity\": " << (c.unity ? "true" : "false")
+             << ", \"median_ms\": " << c.median << " }" << (i + 1 < ranked.size() ? "," : "") << "\n";
     }
-    return true;
-}
+    json << "    ]\n}\n";
+    print(table.str(), "\n");
+    fs::path results = "build" + FOLDER_NOTATION + name + "_tune.json";
+    std::ofstream pt(results, std::ios::trunc);
+    pt << json.str();
+    pt.close();
 
-// Gross hack, but the only thing that I've found to work on C++17
-static inline std::time_t file_to_t(const string& path) {
-    auto ft = fs::last_write_time(path);
-    auto sctp = std::chrono::time_point_cast<std::chrono::system_clock::duration>(ft - decltype(ft)::clock::now() + std::chrono::system_clock::now());
-    return std::chrono::system_clock::to_time_t(sctp);
+    // Replace [profile.tuned] in zmake.cfg, or add it at the end
+    const TuneCandidate& best = ranked.front();
+    string flags = (streq(best.march, "") ? "" : "-march=" + best.march) + (streq(best.march, "") || streq(best.flags, "") ? "" : " ") + best.flags;
+    string section = "[profile.tuned]\ncompiler = \"" + best.compiler + "\"\noptimization = \"" + best.optimization + "\"\nflags = \"" +
+                     flags + "\"\nlto = \"" + best.lto + "\"\n" + (best.unity ? "" : "unity = \"false\"\n");
+    std::ifstream qt("zmake.cfg");
+    string cfg = "";
+    string line;
+    bool in_tuned = false;
+    while (getline(qt, line)) {
+        if (std::regex_match(line, std::regex("^\\[(.*)\\](.*)"))) in_tuned = streq(line.substr(0, 15), "[profile.tuned]");
+        if (!in_tuned) cfg += line + "\n";
+    }
+    qt.close();
+    while (ends_with(cfg, "\n\n")) cfg.pop_back();
+    pt.open("zmake.cfg", std::ios::trunc);
+    pt << cfg << "\n" << section;
+    pt.close();
+    print("- Saved results to \"", results.u8string(), "\".\n");
+    print("- Wrote the fastest combination to [profile.tuned], build it with \"zmake build -profile=tuned\".\n");
+    return EXIT_SUCCESS;
 }
 
-// Uses ends_with
-static inline bool is_file_include(const string& str) {
-    if (str.substr(0, 1).compare("-") == 0) return false;
-    if (ends_with(str, string(".*")))   return true;
-    if (ends_with(str, string(".c")))   return true;
-    if (ends_with(str, string(".cc")))  return true;
-    if (ends_with(str, string(".cpp"))) return true;
-    if (ends_with(str, string(".c++"))) return true;
-    if (ends_with(str, string(".cxx"))) return true;
-    if (ends_with(str, string(".zpp"))) return true;
-    if (ends_with(str, string(".z")))   return true;
-    return false;
-}
+// Serves "zmake worker": compiles the preprocessed files clients send on up to slots compilers
+// at a time. Only gcc and clang are run, without a shell and with worker_flag_allowed() flags,
+// but anyone who can connect can use them, so only listen on addresses you trust.
+static int run_worker(const string& address, unsigned int slots) {
+    #ifdef _WIN32
+    (void)address;
+    (void)slots;
+    print("- Workers aren't supported on Windows yet, aborting.\n");
+    return EXIT_FAILURE;
+    #else
+    signal(SIGPIPE, SIG_IGN);
+    int server = -1;
+    if (streq(address.substr(0, 5), "unix:")) {
+        sockaddr_un addr {};
+        addr.sun_family = AF_UNIX;
+        string path = address.substr(5);
+        if (path.length() < sizeof(addr.sun_path)) {
+            std::copy(path.begin(), path.end(), addr.sun_path);
+            fs::remove(path);
+            server = socket(AF_UNIX, SOCK_STREAM, 0);
+            if (server >= 0 && bind(server, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0) {
+                close(server);
+                server = -1;
+            }
+        }
+    }
+    else if (address.find_last_of(':') != string::npos) {
+        std::size_t colon = address.find_last_of(':');
+        addrinfo hints {};
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+        hints.ai_flags = AI_PASSIVE;
+        addrinfo* res = nullptr;
+        string host = address.substr(0, colon);
+        if (getaddrinfo(streq(host, "") ? nullptr : host.c_str(), address.substr(colon + 1).c_str(), &hints, &res) == 0) {
+            for (addrinfo* p = res; p != nullptr; p = p->ai_next) {
+                server = socket(p->ai_family, p->ai_socktype, p->ai_protocol);
+                if (server < 0) continue;
+                int yes = 1;
+                setsockopt(server, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+                if (bind(server, p->ai_addr, p->ai_addrlen) == 0) break;
+                close(server);
+                server = -1;
+            }
+            freeaddrinfo(res);
+        }
+    }
+    if (server < 0 || listen(server, 64) != 0) {
+        print("- Couldn't listen on \"", address, "\", aborting.\n");
+        return EXIT_FAILURE;
+    }
+    fs::path tmp_dir = fs::temp_directory_path() / ("zmake_worker_" + std::to_string(getpid()));
+    fs::create_directories(tmp_dir);
+    print("- Worker listening on ", address, " with ", slots, " slots.\n");
 
-static inline void change_folder_notation(string& str) {
-    for (char& c: str) if (c == '\\' || c == '/') c = FOLDER_NOTATION.at(0);
-}
+    // Shared with the connection threads, which outlive this scope only if accept() fails
+    static std::mutex mutex;
+    static std::condition_variable cv;
+    static unsigned int jobs = 0;       // Accepted compile jobs, running or waiting for a slot
+    static unsigned int running = 0;
+    static unsigned long long counter = 0;
 
-static inline bool str_is_in_vec(const string& str, const std::vector<string>& vec) {
-    for (const string& s: vec) if (str.compare(s) == 0) return true;
-    return false;
-}
+    auto serve = [tmp_dir, slots](int client) {
+        string line;
+        if (!recv_line(client, line)) return;
+        if (streq(line, "LOAD")) {
+            double load = 0.0;
+            if (getloadavg(&load, 1) != 1) load = 0.0;
+            std::unique_lock<std::mutex> lock(mutex);
+            send_all(client, "LOAD " + std::to_string(jobs) + " " + std::to_string(slots) + " " + std::to_string(load) + "\n");
+            return;
+        }
+        string tag;
+        std::size_t flags_size = 0;
+        std::size_t source_size = 0;
+        string ext;
+        std::istringstream iss(line);
+        // 256 MB is more than any preprocessed file, and keeps one request from taking all the memory
+        if (!(iss >> tag >> flags_size >> source_size >> ext) || !streq(tag, "COMPILE") || !streq(ext, ".i", ".ii") ||
+            flags_size > 65536 || source_size > (std::size_t(1) << 28)) {
+            send_all(client, "ERROR bad request\n");
+            return;
+        }
+        string flags;
+        string source;
+        if (!recv_bytes(client, flags_size, flags) || !recv_bytes(client, source_size, source)) return;
+        std::vector<string> args = split_args(flags);
+        string compiler = args.size() > 0 ? args.at(0) : "";
+        if (!std::regex_match(compiler, std::regex("(gcc|g\\+\\+|cc|c\\+\\+|clang|clang\\+\\+)(-[0-9.]+)?"))) {
+            send_all(client, "ERROR compiler \"" + compiler + "\" isn't allowed\n");
+            return;
+        }
+        for (std::size_t i = 1; i < args.size(); i++) {
+            if (worker_flag_allowed(args.at(i))) continue;
+            send_all(client, "ERROR flag \"" + args.at(i) + "\" isn't allowed\n");
+            return;
+        }
+        fs::path compiler_path = find_in_path(compiler);
+        if (compiler_path.empty()) {
+            // 127 like a shell that can't find it, so the client compiles locally
+            send_all(client, "DONE 127 0 0\n");
+            return;
+        }
 
-static inline bool str_is_in_vec(const string& str, const std::vector<fs::path>& vec) {
-    for (const fs::path& s: vec) if (str.compare(s.u8string()) == 0) return true;
-    return false;
+        std::unique_lock<std::mutex> lock(mutex);
+        jobs++;
+        string id = std::to_string(counter++);
+        cv.wait(lock, [slots]() { return running < slots; });
+        running++;
+        lock.unlock();
+
+        fs::path input = tmp_dir / (id + ext);
+        fs::path output = tmp_dir / (id + ".o");
+        fs::path log = tmp_dir / (id + ".log");
+        std::ofstream pt(input, std::ios::binary | std::ios::trunc);
+        pt << source;
+        pt.close();
+        args.erase(args.begin());
+        args.insert(args.end(), { "-c", input.u8string(), "-o", output.u8string() });
+        RunOptions options;
+        options.output = log.u8string();
+        RunStats stats;
+        int status = run_program(compiler_path.u8string(), args, stats, options);
+        string object = status == 0 ? read_file(output) : "";
+        string messages = read_file(log);
+        fs::remove(input);
+        fs::remove(output);
+        fs::remove(log);
+
+        lock.lock();
+        running--;
+        jobs--;
+        cv.notify_all();
+        print("- Compiled job ", id, " in ", stats.wall_ms, " ms with code ", status, ".\n");
+        lock.unlock();
+        send_all(client, "DONE " + std::to_string(status) + " " + std::to_string(object.length()) + " " +
+                         std::to_string(messages.length()) + "\n" + object + messages);
+    };
+
+    while (true) {
+        int client = accept(server, nullptr, nullptr);
+        if (client < 0) {
+            if (errno == EINTR) continue;
+            print("- Couldn't accept connections, aborting.\n");
+            return EXIT_FAILURE;
+        }
+        std::thread([serve, client]() {
+            serve(client);
+            close(client);
+        }).detach();
+    }
+    #endif
 }
 
 // * * * * * * * * * * MAIN * * * * * * * * * *
@@ -243,17 +3400,26 @@ static inline bool str_is_in_vec(const string& str, const std::vector<fs::path>&
     You can also type zmake gl projname (gl = gitless), to make a new program without git.
     -dev, -debug, -release
     -gcc, -clang-, -clang++, -msvc
-    -nocmd, -notime, -nobuild, -nounity, -norun, -run
+    -nocmd, -notime, -nobuild, -nounity, -norun, -run, -stats, -allocstats (or alloc = "true" in a profile)
+    bench: -n N, -warmup W, -pin=CPU, -threshold=PERCENT, -baseline=FILE, -save
+    pgo: -retrain
+    profile: -freq=HZ, -sampler; builds name_release_profile, writes build/name_release_profile.folded and .svg
+    tune: the bench flags, writes [profile.tuned]; -profile=NAME builds any [profile.NAME]
+    test: -timeout=SECONDS, -shard=i/n, -norun (only build the tests)
+    worker: -listen=host:port or -listen=unix:/path, -j=N; builds use -workers=a,b or [build] workers = "a b"
+    -lto=thin, -lto=full, -lto=off
+    -j=N (parallel jobs), -target=NAME (only build/run this target), -max_memory=SIZE (for parallel jobs)
+    A zmake.workspace with [member.name] path = "dir", depends = "other names" builds every member.
+    Profiles can set linker = "lld"/"mold"/"gold"/"auto" and split_dwarf = "true".
+    [build] global_modules = "true" includes only the parts of global.hpp a .zpp uses, from global/include/global.
+    Everything after "--" is passed on to the program when running it.
     -std=c++17 = /std:c+17 = -c++17 => c++17
     * * * Clang-cl/msvc specific * * *:
     -fexceptions -> -EHsc
     -O0 -> -Od  // It recognizes -Ofast as -O2 by default, but not -O0.
     Adds libraries with -link -libpath:"dir" at the end of the compilation string.
 
-    BUGS: Opening an executable without an extension doesn't work on Windows.
-    - Opening "C:\zmake\build\Ny mapp\zztest_debug"
-    'C:\zmake\build\Ny' is not recognized as an internal or external command, operable program or batch file.
-    Running build files with zmake *.* takes in all files like zmake.cfg and adds it to the program name.
+    BUGS: Running build files with zmake *.* takes in all files like zmake.cfg and adds it to the program name.
     
     NOTES:
     "C:\\zmake\\global\\defaultconfig.cfg" path
@@ -285,33 +3451,62 @@ int main(int argc, char* argv[]) {
     string build_profile  = "";     // "debug"
     string compiler       = "";     // "gcc"
     string optimization   = "";     // "-Ofast"
+    string lto            = "";     // "thin"
+    unsigned int lto_jobs = std::max(1U, std::thread::hardware_concurrency());
+    unsigned int jobs_num = std::max(1U, std::thread::hardware_concurrency());
+    string linker         = "";     // "mold"
 
     bool has_program_name_flag  = false;    // Otherwise name it according to cfg
     bool has_cversion_flag      = false;    // Otherwise use standard
     bool has_build_profile_flag = false;    // Otherwise use standard
     bool has_compiler_flag      = false;    // Otherwise use standard
     bool has_optimization_flag  = false;    // Otherwise use standard
+    bool has_lto_flag           = false;    // Otherwise use standard
+    bool has_jobs_flag          = false;    // Otherwise use standard
     bool has_output_flag        = false;    // Otherwise just add -o, NOTE: doesn't have its own line in the cfg
 
     std::vector<string> cppfiles;       // *.c *.cpp build/debug/main.cpp
     bool build_manual_files = false;    // Otherwise build /src
 
     bool use_run    = true;     // Otherwise don't run it, NOTE: "dont_use_build" is STATE_OPEN
+    bool use_stats  = false;    // Otherwise don't print resource usage after running
+    bool use_bench  = false;    // Otherwise don't benchmark after building
+    BenchOptions bench;
+    bool use_pgo    = false;    // Otherwise don't train and use a profile
+    PgoOptions pgo;
+    bool use_test   = false;    // Otherwise don't build and run the tests
+    TestOptions test;
+    bool use_tune   = false;    // Otherwise don't search for the fastest flags
+    bool use_profile = false;   // Otherwise don't profile the program
+    ProfileOptions profile;
     bool use_time   = true;     // Otherwise don't print compilation time
     bool use_unity  = true;     // Otherwise don't use unity builds
     bool use_cmd    = true;     // Otherwise don't show the command
     bool use_zpp    = true;     // Otherwise don't add zpp features
     bool use_git    = true;     // Otherwise don't create .git and .gitignore
+    bool use_split_dwarf = false;   // Otherwise keep debug info in the executable
+    bool use_allocstats = false;    // Otherwise don't count the program's allocations
+    bool use_global_modules = false;    // Otherwise #include "global.hpp" includes all of it
 
     // For building both with and without build_manual_files
     std::vector<string> build_files;
-    std::vector<fs::path> zfiles;  // /src, /lib, /global/lib
     std::vector<fs::path> zfiles_inclist;  // /src, /lib, /global/lib
+    std::vector<Target> targets;            // [target.name] sections
+    std::vector<Library> libraries;         // [library.name] sections
+    string selected_target = "";            // -target=name
+    string worker_address = "127.0.0.1:7070";   // "zmake worker -listen=host:port" or "-listen=unix:/path"
+    bool has_workers_flag = false;          // -workers=list takes priority over [build] workers
+    bool has_max_memory_flag = false;       // -max_memory=size takes priority over [build] max_memory
 
-    // Commands used in everything
+    // Commands used in everything, and arguments after "--" for the program
     std::vector<string> commands;
+    std::vector<string> run_args;
     commands.reserve(static_cast<unsigned int>(argc));
     for (int i = 1; i < argc; i++) {
+        if (streq(argv[i], "--")) {
+            for (i++; i < argc; i++) run_args.emplace_back(string(argv[i]));
+            break;
+        }
         commands.emplace_back(string(argv[i]));
     }
 
@@ -342,6 +3537,26 @@ int main(int argc, char* argv[]) {
             return EXIT_FAILURE;
         }
     }
+    else if (streq(commands.at(0), "worker")) {
+        state = STATE_WORKER;
+        commands.erase(commands.begin());
+        for (unsigned int i = 0; i < commands.size(); i++) {
+            if (streq(commands.at(i).substr(0, 8), "-listen=", "/listen=")) worker_address = commands.at(i).substr(8);
+            else if (streq(commands.at(i).substr(0, 2), "-j", "/j") && commands.at(i).length() > 2) {
+                double value = 0.0;
+                string arg = commands.at(i).substr(2);
+                if (streq(arg.substr(0, 1), "=")) arg = arg.substr(1);
+                if (!to_number(arg, value) || value < 1.0) {
+                    print("- Invalid number of jobs \"", commands.at(i), "\", aborting.\n");
+                    return EXIT_FAILURE;
+                }
+                jobs_num = static_cast<unsigned int>(value);
+            }
+            else continue;
+            commands.erase(commands.begin() + i);
+            i--;
+        }
+    }
     else if (streq(commands.at(0), "new", "gl", "gitless")) {
         if (streq(commands.at(0), "gl", "gitless")) use_git = false;
         state = STATE_NEW;
@@ -353,7 +3568,7 @@ int main(int argc, char* argv[]) {
     }
     // Gets STATE_BUILD/STATE_OPEN, build_manual_files and has_build_profile_flag
     // Needs to get build_profile for opening -debug
-    else if (streq(commands.at(0), "open", "run", "build", "debug") || is_file_include(commands.at(0))) {
+    else if (streq(commands.at(0), "open", "run", "build", "debug", "bench", "pgo", "test", "tune", "profile") || is_file_include(commands.at(0))) {
         state = STATE_BUILD;    // Can change to STATE_OPEN with "open" or "-nobuild"
 
         // If you build with files
@@ -372,7 +3587,14 @@ int main(int argc, char* argv[]) {
             if (streq(commands.at(0), "run"))   build_profile = "dev";
             if (streq(commands.at(0), "build")) build_profile = "release";
             if (streq(commands.at(0), "debug")) build_profile = "debug";
-            if (streq(commands.at(0), "build", "debug")) use_run = false;
+            if (streq(commands.at(0), "bench", "pgo", "tune", "profile")) build_profile = "release";
+            if (streq(commands.at(0), "bench")) use_bench = true;
+            if (streq(commands.at(0), "tune")) use_tune = true;
+            if (streq(commands.at(0), "pgo")) use_pgo = true;
+            if (streq(commands.at(0), "profile")) use_profile = true;
+            if (streq(commands.at(0), "test")) build_profile = "dev";
+            if (streq(commands.at(0), "test")) use_test = true;   // use_run runs the tests
+            if (streq(commands.at(0), "build", "debug", "bench", "pgo", "tune", "profile")) use_run = false;
             else use_run = true;
             commands.erase(commands.begin());
         }
@@ -384,6 +3606,10 @@ int main(int argc, char* argv[]) {
                     print("- Need to build when only specifying files, aborting.\n");
                     return EXIT_FAILURE;
                 }
+                if (use_bench || use_pgo || use_test || use_tune || use_profile) {
+                    print("- Need to build when benchmarking, training, testing, tuning or profiling, aborting.\n");
+                    return EXIT_FAILURE;
+                }
                 state = STATE_OPEN;
                 commands.erase(commands.begin() + i);
                 i--;
@@ -399,15 +3625,36 @@ int main(int argc, char* argv[]) {
                 commands.erase(commands.begin() + i);
                 i--;
             }
-            if (streq(commands.at(i), "-run", "/run")) {
+            else if (streq(commands.at(i), "-run", "/run")) {
                 use_run = true;
                 commands.erase(commands.begin() + i);
                 i--;
             }
+            else if (streq(commands.at(i), "-stats", "/stats")) {
+                use_stats = true;
+                commands.erase(commands.begin() + i);
+                i--;
+            }
+            else if (streq(commands.at(i).substr(0, 8), "-target=", "/target=")) {
+                selected_target = commands.at(i).substr(8);
+                commands.erase(commands.begin() + i);
+                i--;
+            }
         }
 
-        // Get build profile
+        // Get build profile, -profile=name picks any [profile.name], like the one "zmake tune" writes
         for (unsigned int i = 0; i < commands.size(); i++) {
+            if (streq(commands.at(i).substr(0, 9), "-profile=", "/profile=") && commands.at(i).length() > 9) {
+                if (has_build_profile_flag) {
+                    print("- Multiple build profile arguments, aborting.\n");
+                    return EXIT_FAILURE;
+                }
+                has_build_profile_flag = true;
+                build_profile = commands.at(i).substr(9);
+                commands.erase(commands.begin() + i);
+                i--;
+                continue;
+            }
             if (streq(commands.at(i), "-dev", "-debug", "-release", "-custom", "/dev", "/debug", "/release", "/custom")) {
                 if (state != STATE_OPEN && streq(commands.at(i), "-custom", "/custom")) {
                     print("- Build profile \"custom\" can only be called when opening files, aborting.\n");
@@ -426,6 +3673,125 @@ int main(int argc, char* argv[]) {
                 }
             }
         }
+
+        // Benchmark settings, flags take priority over [bench] in zmake.cfg
+        if (use_bench || use_tune) {
+            double value = 0.0;
+            if (to_number(config_value("bench", "runs"), value))        bench.runs = static_cast<int>(value);
+            if (to_number(config_value("bench", "warmup"), value))      bench.warmup = static_cast<int>(value);
+            if (to_number(config_value("bench", "cpu"), value))         bench.cpu = static_cast<int>(value);
+            if (to_number(config_value("bench", "threshold"), value))   bench.threshold = value;
+            bench.baseline = config_value("bench", "baseline", "");
+
+            for (unsigned int i = 0; i < commands.size(); i++) {
+                if (!streq(commands.at(i).substr(0, 1), "-", "/")) continue;
+                string flag = commands.at(i).substr(1);
+                string key = flag.substr(0, flag.find('='));
+                if (!streq(key, "n", "warmup", "pin", "threshold", "baseline", "save")) continue;
+                commands.erase(commands.begin() + i);
+                if (streq(key, "save")) {
+                    bench.save_baseline = true;
+                    i--;
+                    continue;
+                }
+                // Both -n=10 and -n 10 work
+                string arg = "";
+                if (flag.find('=') != string::npos) arg = flag.substr(flag.find('=') + 1);
+                else if (i < commands.size()) {
+                    arg = commands.at(i);
+                    commands.erase(commands.begin() + i);
+                }
+                i--;
+                if (streq(key, "baseline")) {
+                    bench.baseline = arg;
+                    continue;
+                }
+                if (!to_number(arg, value) || value < 0.0) {
+                    print("- Invalid value \"", arg, "\" for \"-", key, "\", aborting.\n");
+                    return EXIT_FAILURE;
+                }
+                if (streq(key, "n"))            bench.runs = static_cast<int>(value);
+                if (streq(key, "warmup"))       bench.warmup = static_cast<int>(value);
+                if (streq(key, "pin"))          bench.cpu = static_cast<int>(value);
+                if (streq(key, "threshold"))    bench.threshold = value;
+            }
+            if (bench.runs < 1) {
+                print("- Need at least one run to benchmark, aborting.\n");
+                return EXIT_FAILURE;
+            }
+            #ifndef __linux__
+            if (bench.cpu >= 0) {
+                print("- CPU pinning is only supported on Linux, ignoring.\n");
+                bench.cpu = -1;
+            }
+            #endif
+        }
+
+        // Test settings, flags take priority over [test] in zmake.cfg
+        if (use_test) {
+            double value = 0.0;
+            if (to_number(config_value("test", "timeout"), value) && value >= 0.0) test.timeout = value;
+            for (unsigned int i = 0; i < commands.size(); i++) {
+                if (streq(commands.at(i).substr(0, 9), "-timeout=", "/timeout=")) {
+                    if (!to_number(commands.at(i).substr(9), value) || value < 0.0) {
+                        print("- Invalid timeout \"", commands.at(i), "\", aborting.\n");
+                        return EXIT_FAILURE;
+                    }
+                    test.timeout = value;
+                }
+                else if (streq(commands.at(i).substr(0, 7), "-shard=", "/shard=")) {
+                    // -shard=i/n, e.g. -shard=2/4 on the second of four CI machines
+                    string arg = commands.at(i).substr(7);
+                    double shard = 0.0;
+                    double shards = 0.0;
+                    if (arg.find('/') == string::npos || !to_number(arg.substr(0, arg.find('/')), shard) ||
+                        !to_number(arg.substr(arg.find('/') + 1), shards) || shard < 1.0 || shard > shards) {
+                        print("- Invalid shard \"", commands.at(i), "\", use -shard=i/n with 1 <= i <= n, aborting.\n");
+                        return EXIT_FAILURE;
+                    }
+                    test.shard = static_cast<unsigned int>(shard);
+                    test.shards = static_cast<unsigned int>(shards);
+                }
+                else continue;
+                commands.erase(commands.begin() + i);
+                i--;
+            }
+        }
+
+        // Profiling settings, -freq=HZ and -sampler (even if perf works)
+        if (use_profile) {
+            double value = 0.0;
+            for (unsigned int i = 0; i < commands.size(); i++) {
+                if (streq(commands.at(i).substr(0, 6), "-freq=", "/freq=")) {
+                    if (!to_number(commands.at(i).substr(6), value) || value < 1.0 || value > 100000.0) {
+                        print("- Invalid frequency \"", commands.at(i), "\", aborting.\n");
+                        return EXIT_FAILURE;
+                    }
+                    profile.frequency = static_cast<int>(value);
+                }
+                else if (streq(commands.at(i), "-sampler", "/sampler")) profile.sampler = true;
+                else continue;
+                commands.erase(commands.begin() + i);
+                i--;
+            }
+        }
+
+        // Training settings, arguments after "--" take priority over [pgo] in zmake.cfg
+        if (use_pgo) {
+            pgo.command = config_value("pgo", "command");
+            pgo.args = split_args(config_value("pgo", "args"));
+            if (run_args.size() != 0) {
+                pgo.command = "";
+                pgo.args = run_args;
+            }
+            for (unsigned int i = 0; i < commands.size(); i++) {
+                if (streq(commands.at(i), "-retrain", "/retrain")) {
+                    pgo.retrain = true;
+                    commands.erase(commands.begin() + i);
+                    i--;
+                }
+            }
+        }
     }
     else {
         state = STATE_UNKNOWN;
@@ -461,19 +3827,37 @@ R"(
 - Build and run the dev build with "zmake run".
 - Build the release build with "zmake build".
 - Build the debug build with "zmake debug".
+- Benchmark the release build with "zmake bench -n 10 -warmup 1",
+- with "-pin=CPU", "-threshold=PERCENT", "-baseline=FILE" or "-save" (as baseline).
+- Build the release build with profile-guided optimization with "zmake pgo",
+- it retrains when the sources change or with "-retrain".
+- Profile the release build with "zmake profile", it writes a flamegraph
+- to /build, with "-freq=HZ" or "-sampler" (when perf doesn't work).
+- Find the fastest flags from [tune] in zmake.cfg with "zmake tune",
+- it writes them to [profile.tuned] (build it with "-profile=tuned").
+- Build and run the tests in /tests in parallel with "zmake test",
+- with "-timeout=SECONDS" (per test) and "-shard=i/n" (for CI).
+- Start a worker for distributed compilation with "zmake worker",
+- with "-listen=host:port" or "-listen=unix:/path" and "-j=N".
 - Open the most recently compiled build with "zmake open".
 - Remove build files with "zmake clean".
 
 - You can also add any "-gccflags" at the end of your command
 - to compile with them, or the following built in commands:
-- "-dev/-debug/-release" (change build profile),
+- "-dev/-debug/-release/-profile=name" (change build profile),
 - "-nocmd" (hide compiler command),
 - "-notime" (hide compilation time),
 - "-nobuild" (only running),
 - "-nounity" (turn off unity builds),
 - "-norun" (only building),
 - "-run" (run after building),
+- "-stats" (print time, memory and page faults after running, and the compilers' memory),
+- "-lto=thin/-lto=full/-lto=off" (link-time optimization),
+- "-workers=host:port,unix:/path" (compile on zmake workers),
+- "-max_memory=8G" (keep parallel compile jobs under this much memory),
+- "-allocstats" (count the program's allocations and report them at exit),
 - or "-gcc/-clang/-clang++" to change compiler.
+- Arguments after "--" are passed to the program.
 )");
         return EXIT_SUCCESS;
     }
@@ -483,6 +3867,10 @@ R"(
         return EXIT_SUCCESS;
     }
 
+    if (state == STATE_WORKER) {
+        return run_worker(worker_address, jobs_num);
+    }
+
     if (state == STATE_CLEAN) {
         if (!fs::exists("src")) {
             print("- Not a zmake directory, aborting.\n");
@@ -594,60 +3982,65 @@ R"(
             print("- Build directory doesn't exist, aborting.\n");
             return EXIT_FAILURE;
         }
-        // Find latest executable
-        std::vector<fs::path> programs;
-        programs.reserve(3);
-
-        for (const auto& p: fs::recursive_directory_iterator("build")) {
-            if (fs::is_directory(p.path())) continue;
-            if (!streq(p.path().extension().u8string(), "", ".exe")) continue;
-            programs.emplace_back(p.path());
-        }
+        // The executable is always build/name_profile, so we only need to look at the profiles
+        program_name = config_value("package", "name", fs::current_path().stem().u8string());
+        if (!streq(selected_target, "")) program_name = selected_target;
+        std::vector<string> profiles = { "dev", "debug", "release", "custom" };
+        if (!streq(build_profile, "")) profiles = { build_profile };
 
-        if (programs.size() == 0) {
-            print("- No executables found, aborting.\n");
-            return EXIT_FAILURE;
-        }
-        // If build_profile == "" from open, then just take any old exe
-        if (streq(build_profile, "dev", "debug", "release", "custom")) {
-            for (unsigned int i = 0; i < programs.size(); i++) {
-                if (!ends_with(programs.at(i).u8string(), "_" + build_profile) &&
-                    !ends_with(programs.at(i).u8string(), "_" + build_profile + ".exe")) {
-                    programs.erase(programs.begin() + i);
-                    i--;
-                }
-            }
-            if (programs.size() == 0) {
-                print("- No \"" + build_profile + "\" build executable found, aborting.\n");
-                return EXIT_FAILURE;
+        fs::path program = "";
+        fs::file_time_type best_time;
+        for (const string& profile: profiles) {
+            fs::path candidate = "build" + FOLDER_NOTATION + program_name + "_" + profile;
+            if (ON_WINDOWS) candidate += ".exe";
+            if (!fs::exists(candidate)) continue;
+            // If build_profile == "" from open, then take the most recent one
+            fs::file_time_type candidate_time = fs::last_write_time(candidate);
+            if (streq(program.u8string(), "") || candidate_time > best_time) {
+                program = candidate;
+                best_time = candidate_time;
             }
         }
-
-        std::time_t bestTime = file_to_t(programs.at(0).u8string());
-        std::time_t tempTime;
-
-        for (unsigned int i = 1; i < programs.size(); i++) {
-            tempTime = file_to_t(programs.at(i).u8string());
-            if (tempTime > bestTime) {
-                bestTime = tempTime;
-                programs.erase(programs.begin(), programs.begin() + i);
-                i = 0;
-            }
+        if (streq(program.u8string(), "")) {
+            if (streq(build_profile, "")) print("- No executables found, aborting.\n");
+            else print("- No \"" + build_profile + "\" build executable found, aborting.\n");
+            return EXIT_FAILURE;
         }
         // Open the program
-        string progname = programs.at(0).stem().u8string() + programs.at(0).extension().u8string();
-        print("- Opening " + progname + ".\n\n");
-        string progcmd = "\"" + fs::absolute(programs.at(0)).u8string() + "\"";
-        system(progcmd.c_str());
-
-        return EXIT_SUCCESS;
+        print("- Opening " + program.filename().u8string() + ".\n\n");
+        return open_program(program, run_args, use_stats);
     }
 
     if (state == STATE_BUILD) {
+        jobserver_connect();
+        if (!build_manual_files && !fs::exists("src") && fs::exists("zmake.workspace")) {
+            if (use_bench || use_pgo || use_profile) {
+                print("- Benchmarking, training and profiling need a single project, aborting.\n");
+                return EXIT_FAILURE;
+            }
+            if (use_tune) {
+                print("- Tuning needs a single project, aborting.\n");
+                return EXIT_FAILURE;
+            }
+            if (use_run && !use_test) print("- Workspaces are only built, not run.\n");
+            if (use_test && !use_run) commands.emplace_back("-norun");
+            return build_workspace(self_path(argv[0]), use_test, build_profile, commands);
+        }
         if (!build_manual_files && !fs::exists("src")) {
             print("- Not a zmake directory, aborting.\n");
             return EXIT_FAILURE;
         }
+        if (use_tune) {
+            if (build_manual_files) {
+                print("- Tuning needs a zmake directory, aborting.\n");
+                return EXIT_FAILURE;
+            }
+            return run_tune(self_path(argv[0]), bench, run_args, commands);
+        }
+        if (use_profile && build_manual_files) {
+            print("- Profiling needs a zmake directory, aborting.\n");
+            return EXIT_FAILURE;
+        }
         // Get compiler, cversion, optimization, -o/-c/-E/-S, program_name
         // i.e. flags that change defaults
         // Get also the last zmake flags, i. e. -notime, -nocmd
@@ -704,8 +4097,50 @@ R"(
                 commands.erase(commands.begin() + i);
                 i--;
             }
-            else if (streq(commands.at(i), "-nounity", "/nounity")) {
-                use_unity = false;
+            else if (streq(commands.at(i), "-nounity", "/nounity")) {
+                use_unity = false;
+                commands.erase(commands.begin() + i);
+                i--;
+            }
+            else if (streq(commands.at(i), "-allocstats", "/allocstats")) {
+                use_allocstats = true;
+                commands.erase(commands.begin() + i);
+                i--;
+            }
+            else if (streq(commands.at(i).substr(0, 2), "-j", "/j") && commands.at(i).length() > 2) {
+                double value = 0.0;
+                string arg = commands.at(i).substr(2);
+                if (streq(arg.substr(0, 1), "=")) arg = arg.substr(1);
+                if (!to_number(arg, value) || value < 1.0) {
+                    print("- Invalid number of jobs \"", commands.at(i), "\", aborting.\n");
+                    return EXIT_FAILURE;
+                }
+                has_jobs_flag = true;
+                jobs_num = static_cast<unsigned int>(value);
+                commands.erase(commands.begin() + i);
+                i--;
+            }
+            else if (streq(commands.at(i).substr(0, 12), "-max_memory=", "/max_memory=")) {
+                if (!to_kilobytes(commands.at(i).substr(12), max_memory_kb)) {
+                    print("- Invalid memory size \"", commands.at(i), "\", use a size like \"8G\" or \"auto\", aborting.\n");
+                    return EXIT_FAILURE;
+                }
+                has_max_memory_flag = true;
+                commands.erase(commands.begin() + i);
+                i--;
+            }
+            else if (streq(commands.at(i).substr(0, 9), "-workers=", "/workers=")) {
+                has_workers_flag = true;
+                string list = commands.at(i).substr(9);
+                std::replace(list.begin(), list.end(), ',', ' ');
+                workers.clear();
+                for (const string& address: split_args(list)) workers.emplace_back(Worker { address });
+                commands.erase(commands.begin() + i);
+                i--;
+            }
+            else if (streq(commands.at(i).substr(0, 5), "-lto=", "/lto=")) {
+                has_lto_flag = true;
+                lto = commands.at(i).substr(5);
                 commands.erase(commands.begin() + i);
                 i--;
             }
@@ -817,6 +4252,26 @@ R"(
                         if (streq(cversion.substr(0, 1), "-", "/")) cversion = cversion.substr(1);
                         if (streq(cversion.substr(0, 4), "std=", "std:")) cversion = cversion.substr(4);
                     }
+                    else if (streq(current_flag, "jobs")) {
+                        double value = 0.0;
+                        if (!has_jobs_flag && to_number(matches[4], value) && value >= 1.0) jobs_num = static_cast<unsigned int>(value);
+                    }
+                    else if (streq(current_flag, "max_memory")) {
+                        if (has_max_memory_flag) continue;
+                        if (!to_kilobytes(matches[4], max_memory_kb)) {
+                            print("- Invalid max_memory \"", string(matches[4]), "\", use a size like \"8G\" or \"auto\", aborting.\n");
+                            return EXIT_FAILURE;
+                        }
+                    }
+                    else if (streq(current_flag, "workers")) {
+                        if (has_workers_flag) continue;
+                        string list = matches[4];
+                        std::replace(list.begin(), list.end(), ',', ' ');
+                        for (const string& address: split_args(list)) workers.emplace_back(Worker { address });
+                    }
+                    else if (streq(current_flag, "global_modules")) {
+                        use_global_modules = streq(string(matches[4]), "true", "yes", "on", "1");
+                    }
                     else if (streq(current_flag, "autoflags")) {
                         if (!streq(config_flags, "")) config_flags += " ";
                         config_flags += matches[4];
@@ -856,6 +4311,58 @@ R"(
                         }
                     }
                 }
+                else if (streq(current_profile.substr(0, 7), "target.") && !build_manual_files) {
+                    if (targets.size() == 0 || targets.back().test || !streq(targets.back().name, current_profile.substr(7))) {
+                        targets.emplace_back(Target { current_profile.substr(7), "" });
+                    }
+                    if (streq(current_flag, "entry")) {
+                        in = matches[4];
+                        change_folder_notation(in);
+                        if (!fs::exists(in)) {
+                            print("- Entry file \"" + in + "\" of ", current_profile, " doesn't exist, aborting.\n");
+                            return EXIT_FAILURE;
+                        }
+                        targets.back().entry = fs::absolute(in);
+                    }
+                    else if (streq(current_flag, "flags")) targets.back().flags = matches[4];
+                }
+                else if (streq(current_profile.substr(0, 5), "test.") && use_test) {
+                    if (targets.size() == 0 || !targets.back().test || !streq(targets.back().name, current_profile.substr(5))) {
+                        targets.emplace_back(Target { current_profile.substr(5), "", true });
+                    }
+                    if (streq(current_flag, "entry")) {
+                        in = matches[4];
+                        change_folder_notation(in);
+                        if (!fs::exists(in)) {
+                            print("- Entry file \"" + in + "\" of ", current_profile, " doesn't exist, aborting.\n");
+                            return EXIT_FAILURE;
+                        }
+                        targets.back().entry = fs::absolute(in);
+                    }
+                    else if (streq(current_flag, "timeout")) {
+                        double value = 0.0;
+                        if (to_number(matches[4], value) && value >= 0.0) targets.back().timeout = value;
+                    }
+                    else if (streq(current_flag, "flags")) targets.back().flags = matches[4];
+                }
+                else if (streq(current_profile.substr(0, 8), "library.") && !build_manual_files) {
+                    string library_name = current_profile.substr(8);
+                    if (libraries.size() == 0 || !streq(libraries.back().name, library_name)) {
+                        libraries.emplace_back(Library { library_name, "src" + FOLDER_NOTATION + library_name, false });
+                    }
+                    if (streq(current_flag, "path")) {
+                        in = matches[4];
+                        change_folder_notation(in);
+                        libraries.back().path = in;
+                    }
+                    else if (streq(current_flag, "type")) {
+                        if (!streq(string(matches[4]), "static", "shared")) {
+                            print("- Library type has to be \"static\" or \"shared\", aborting.\n");
+                            return EXIT_FAILURE;
+                        }
+                        libraries.back().shared = streq(string(matches[4]), "shared");
+                    }
+                }
                 else if (streq(current_profile, "profile." + build_profile)) {
                     if (streq(current_flag, "compiler")) {
                         if (has_compiler_flag) continue;
@@ -867,6 +4374,26 @@ R"(
                         if (has_optimization_flag) continue;
                         optimization = matches[4];
                     }
+                    else if (streq(current_flag, "lto")) {
+                        if (has_lto_flag) continue;
+                        lto = matches[4];
+                    }
+                    else if (streq(current_flag, "linker")) {
+                        linker = matches[4];
+                    }
+                    else if (streq(current_flag, "split_dwarf")) {
+                        use_split_dwarf = streq(string(matches[4]), "true", "yes", "on", "1");
+                    }
+                    else if (streq(current_flag, "unity")) {
+                        if (streq(string(matches[4]), "false", "no", "off", "0")) use_unity = false;
+                    }
+                    else if (streq(current_flag, "alloc")) {
+                        if (streq(string(matches[4]), "true", "yes", "on", "1")) use_allocstats = true;
+                    }
+                    else if (streq(current_flag, "lto_jobs")) {
+                        double jobs = 0.0;
+                        if (to_number(matches[4], jobs) && jobs >= 1.0) lto_jobs = static_cast<unsigned int>(jobs);
+                    }
                     else if (streq(current_flag, "flags")) {
                         if (has_compiler_flag) continue;
                         if (!streq(config_flags, "")) config_flags += " ";
@@ -878,6 +4405,116 @@ R"(
         qt.close();
         commands.emplace_back(optimization);
         if (has_compiler_flag) build_profile = "custom";
+        // Profiling builds its own variant of the profile, with frame pointers for the unwinder and symbols
+        // for the names. The sampler is only linked in when perf doesn't work.
+        if (use_profile) {
+            if (ends_with(compiler, "cl") || ON_WINDOWS) {
+                print("- Profiling is only supported with gcc and clang on Linux and macOS, aborting.\n");
+                return EXIT_FAILURE;
+            }
+            if (!profile.sampler && !perf_works()) {
+                print("- perf isn't available, using the built in sampler.\n");
+                profile.sampler = true;
+            }
+            bool has_debug_flag = false;
+            for (const string& command: commands) if (streq(command.substr(0, 2), "-g")) has_debug_flag = true;
+            if (!has_debug_flag) commands.emplace_back("-g");
+            commands.emplace_back("-fno-omit-frame-pointer");
+            build_profile += "_profile";
+        }
+        if (use_allocstats && (ends_with(compiler, "cl") || ON_WINDOWS)) {
+            print("- Allocation stats are only supported with gcc and clang on Linux and macOS, ignoring.\n");
+            use_allocstats = false;
+        }
+        // Like profiling, so the counting build doesn't replace the normal one
+        if (use_allocstats) build_profile += "_alloc";
+        if (!streq(lto, "", "off", "thin", "full")) {
+            print("- Unknown LTO mode \"", lto, "\", use \"thin\", \"full\" or \"off\", aborting.\n");
+            return EXIT_FAILURE;
+        }
+        // Tests are the files in /tests (helpers can go in subdirectories) and [test.name] sections,
+        // sharded by name so every CI machine gets the same split
+        if (use_test) {
+            if (fs::exists("tests")) {
+                for (const auto& p: fs::directory_iterator("tests")) {
+                    if (fs::is_directory(p.path())) continue;
+                    if (!streq(p.path().extension().u8string(), ".z", ".zpp", ".c", ".cpp", ".cc", ".c++", ".cxx")) continue;
+                    // [test.name] can also just set the timeout of tests/name.zpp
+                    bool listed = false;
+                    for (Target& target: targets) {
+                        if (target.test && target.entry.empty() && streq(target.name, p.path().stem().u8string())) target.entry = fs::absolute(p.path());
+                        if (target.entry == fs::absolute(p.path())) listed = true;
+                    }
+                    if (!listed) targets.emplace_back(Target { p.path().stem().u8string(), fs::absolute(p.path()), true });
+                }
+            }
+            std::vector<Target> tests;
+            std::vector<Target> kept;   // Program targets stay, so their entries aren't linked into the tests
+            for (const Target& target: targets) {
+                if (!target.test) kept.emplace_back(target);
+                else if (target.entry.empty()) {
+                    print("- Test \"", target.name, "\" has no entry in zmake.cfg, aborting.\n");
+                    return EXIT_FAILURE;
+                }
+                else tests.emplace_back(target);
+            }
+            std::sort(tests.begin(), tests.end(), [](const Target& x, const Target& y) { return x.name < y.name; });
+            bool found = streq(selected_target, "");
+            std::size_t test_num = 0;
+            for (std::size_t i = 0; i < tests.size(); i++) {
+                if (!streq(selected_target, "") && !streq(selected_target, tests.at(i).name)) continue;
+                found = true;
+                if (i % test.shards != test.shard - 1) continue;
+                kept.emplace_back(tests.at(i));
+                test_num++;
+            }
+            if (!found) {
+                print("- No test named \"", selected_target, "\", aborting.\n");
+                return EXIT_FAILURE;
+            }
+            if (test_num == 0) {
+                print("- No tests to run.\n");
+                return EXIT_SUCCESS;
+            }
+            targets = kept;
+        }
+        for (const Target& target: targets) {
+            if (!target.test && target.entry.empty()) {
+                print("- Target \"", target.name, "\" has no entry in zmake.cfg, aborting.\n");
+                return EXIT_FAILURE;
+            }
+        }
+        if (targets.size() > 0) {
+            if (has_output_flag) {
+                print("- Output flags can't be used with targets, aborting.\n");
+                return EXIT_FAILURE;
+            }
+            if (use_pgo) {
+                print("- PGO doesn't support targets yet, aborting.\n");
+                return EXIT_FAILURE;
+            }
+            bool found = streq(selected_target, "");
+            for (const Target& target: targets) if (streq(target.name, selected_target)) found = true;
+            if (!found) {
+                print("- No target named \"", selected_target, "\" in zmake.cfg, aborting.\n");
+                return EXIT_FAILURE;
+            }
+        }
+        for (const Library& library: libraries) {
+            if (!fs::exists(library_sources(library))) {
+                print("- Library path \"", library_sources(library).u8string(), "\" doesn't exist, aborting.\n");
+                return EXIT_FAILURE;
+            }
+            if (library.shared && ON_WINDOWS) {
+                print("- Shared libraries aren't supported on Windows yet, aborting.\n");
+                return EXIT_FAILURE;
+            }
+        }
+        if (streq(linker, "auto")) linker = detect_linker(compiler);
+        if (!streq(linker, "", "default", "lld", "mold", "gold")) {
+            print("- Unknown linker \"", linker, "\", use \"lld\", \"mold\", \"gold\", \"auto\" or \"default\", aborting.\n");
+            return EXIT_FAILURE;
+        }
 
         // Import default commands
         std::vector<string> default_commands;
@@ -899,9 +4536,17 @@ R"(
         if (!build_manual_files) {
             for (const auto& p: fs::recursive_directory_iterator("src")) {
                 if (fs::is_directory(p.path())) continue;
+                // Libraries in /src are compiled on their own
+                bool in_library = false;
+                for (const Library& library: libraries) if (is_in_directory(p.path(), library.path)) in_library = true;
+                if (in_library) continue;
                 //in = p.path().relative_path().parent_path().u8string() + FOLDER_NOTATION;
                 if (streq(p.path().extension().u8string(), ".c", ".cpp", ".cc", ".c++", ".cxx")) {
-                    cppfiles.emplace_back(absolute(p.path()).u8string());
+                    bool is_entry = false;
+                    for (const Target& target: targets) if (target.entry == fs::absolute(p.path())) is_entry = true;
+                    // Tests have their own main, so the program's can't be linked in
+                    if (use_test && std::regex_search(read_file(p.path()), std::regex("\\bint\\s+main\\s*\\("))) is_entry = true;
+                    if (!is_entry) cppfiles.emplace_back(absolute(p.path()).u8string());
                 }
                 else if (streq(p.path().extension().u8string(), ".z", ".zpp")) {
                     if (streq(p.path().stem().u8string(), "main")) zfiles_inclist.insert(zfiles_inclist.begin(), p.path());
@@ -934,6 +4579,14 @@ R"(
             }
         }
 
+        // Helper .zpp files for the tests
+        if (use_test && fs::exists("tests")) {
+            for (const auto& p: fs::recursive_directory_iterator("tests")) {
+                if (fs::is_directory(p.path()) || p.path().parent_path() == fs::path("tests")) continue;
+                if (streq(p.path().extension().u8string(), ".z", ".zpp")) zfiles_inclist.emplace_back(p.path());
+            }
+        }
+
         if (zfiles_inclist.size() == 0) use_zpp = false;
 
         // Find main
@@ -948,7 +4601,8 @@ R"(
         bool in_string = false;
         bool in_comment = false;
 
-        for (unsigned int i = 0; i < zfiles_inclist.size(); i++) {
+        // Targets name their own entry files
+        for (unsigned int i = 0; i < zfiles_inclist.size() && targets.size() == 0; i++) {
             qt.open(zfiles_inclist.at(i));
             if (!qt.is_open()) {
                 print("- Couldn't open file \"", zfiles_inclist.at(i), "\", aborting.\n");
@@ -1014,12 +4668,28 @@ R"(
         }
         if (main_entry == -1) {
             use_zpp = false;
-            if (cppfiles.size() == 0)  {
+            if (cppfiles.size() == 0 && targets.size() == 0)  {
                 print("- Couldn't find main function, aborting.\n");
                 return EXIT_FAILURE;
             }
         }
 
+        if (use_profile && profile.sampler) {
+            fs::path sampler = fs::absolute("build" + FOLDER_NOTATION + "zmake_sampler.cpp");
+            pt.open(sampler, std::ios::trunc);
+            pt << SAMPLER_PROGRAM;
+            pt.close();
+            cppfiles.emplace_back(sampler.u8string());
+        }
+        if (use_allocstats) {
+            fs::path alloc = fs::absolute("build" + FOLDER_NOTATION + "zmake_alloc.cpp");
+            if (build_manual_files) alloc = fs::absolute("zmake_alloc.cpp");
+            pt.open(alloc, std::ios::trunc);
+            pt << ALLOC_PROGRAM;
+            pt.close();
+            cppfiles.emplace_back(alloc.u8string());
+        }
+
         // Find more files in includes
         for (unsigned int i = 0; i < cfg_includes.size(); i++) {
             for (const auto& p: fs::recursive_directory_iterator(cfg_includes.at(i))) {
@@ -1030,272 +4700,15 @@ R"(
         }
 
         /* Put the .zpp files into a cpp file */
-        if (use_zpp) zfiles.emplace_back(zfiles_inclist.at(0));  // main
-
-        // 2D vector to store includes along with which files included them to show in *_zmake.cpp
-        std::vector<std::vector<string>> include_list;
-        include_list.reserve(8);
-        const std::regex reg_include("^#include (<(.*?)>|\"(.*)\")(.*)");
-
-        // Forward declarations (reg functions varför funkar du inte)
-        const std::regex reg_structs("^(struct|class|union) (\\S+)\\s*\\{(.*)");
-        const std::regex reg_functions("^((\\S+\\s+)+?)(\\S+)\\((.*)\\)\\s*\\{(.*)"); //[1] type, [2] fcn_name, [3] args.
-        const std::regex reg_template("^template(\\s*)<(.*?)>(.*)");
-        const std::regex reg_args("(.*?)=(.*?),(.*)");
-        const std::regex reg_args_end("(.*?)=(.*)");
-        std::vector<string> forward_structs;
-        std::vector<string> forward_functions;
-        forward_structs.reserve(8);
-        forward_functions.reserve(64);
-        string template_fcn = "";
-
-        bool added_structs = false;
-        bool added_functions = false;
-        string add_structs = "";
-        string add_functions = "";
-
-        // Get includes, and structs, classes, unions and functions
-        // so we can forward declare them, in that order.
-        for (unsigned int i = 0; i < zfiles.size(); i++) {
-            qt.open(zfiles.at(i));
-            if (!qt.is_open()) {
-                print("- Couldn't open file \"", zfiles.at(i), "\", aborting.\n");
-                return EXIT_FAILURE;
-            }
-            // Annotate where structs and functions come from, removed at end if not filled
-            added_structs = false;
-            added_functions = false;
-            add_structs = "// From " + zfiles.at(i).u8string() + "\n";
-            add_functions = "// From " + zfiles.at(i).u8string() + "\n";
-
-            while (getline(qt, read_line)) {
-                forward_declare:
-                if (in_string) {
-                    if (std::regex_match(read_line, matches, reg_string_end)) {
-                        in_string = false;
-                        read_line = matches[2];
-                        goto forward_declare;
-                    }
-                }
-                else if (in_comment) {
-                    if (std::regex_match(read_line, matches, reg_comment_end)) {
-                        in_comment = false;
-                        read_line = matches[2];
-                        goto forward_declare;
-                    }
-                }
-                else if (std::regex_match(read_line, matches, reg_comment_one_line)) {
-                    continue;
-                }
-                else {
-                    if (std::regex_match(read_line, matches, reg_string_start) && !in_comment) {
-                        if (in_string) continue;
-                        else {
-                            in_string = true;
-                            goto forward_declare;
-                        }
-                    }
-                    if (std::regex_match(read_line, matches, reg_comment_start) && !in_string) {
-                        if (in_comment) continue;
-                        else {
-                            in_comment = true;
-                            goto forward_declare;
-                        }
-                    }
-                    // Get { on second line, put this after comment and strings
-                    if (getline(qt, read_line_next)) {
-                        read_line_loop = true;
-                        if (std::regex_match(read_line_next, matches, reg_second_line_bracket)) {
-                            read_line = trim(read_line) + trim(read_line_next);
-                        }
-                    }
-                    if (std::regex_match(read_line, matches, reg_include)) {
-                        bool include_already_exists = false;
-                        string incfile = matches[1];
-                        string zpp_file_inc = incfile.substr(1, incfile.length() - 2);
-                        // Including a .zpp file
-                        if (ends_with(zpp_file_inc, ".zpp") || ends_with(zpp_file_inc, ".z")) {
-                            for (unsigned int j = 0; j < zfiles_inclist.size(); j++) {
-                                if (streq(zfiles_inclist.at(j).filename().u8string(), zpp_file_inc)) {
-                                    if (!str_is_in_vec(zfiles_inclist.at(j).u8string(), zfiles)) {
-                                        zfiles.emplace_back(zfiles_inclist.at(j));
-                                    }
-                                    incfile = "//#include \"" + zpp_file_inc + "\"";
-                                    goto add_include;
-                                }
-                            }
-                            print("- Couldn't find file \"", zpp_file_inc, "\", aborting.\n");
-                            return EXIT_FAILURE;
-                        }
-                        else incfile = "#include " + incfile;
-                        add_include:
-                        for (unsigned int j = 0; j < include_list.size(); j++) {
-                            if (streq(incfile, include_list.at(j).at(0))) {
-                                include_already_exists = true;
-                                include_list.at(j).emplace_back(zfiles.at(i).u8string());
-                                break;
-                            }
-                        }
-                        if (!include_already_exists) {
-                            include_list.emplace_back(std::vector<string> { incfile, zfiles.at(i).u8string() });
-                        }
-                    }
-                    else if (std::regex_match(read_line, matches, reg_structs)) {
-                        string temp_struct = matches[1];
-                        temp_struct += " ";
-                        temp_struct += matches[2];
-                        temp_struct += ";\n";
-                        add_structs += temp_struct;
-                        added_structs = true;
-                    }
-                    else if (std::regex_match(read_line, matches, reg_functions)) {
-                        if (streq("main", matches[3])) continue;
-                        string temp_fcn = template_fcn;
-                        temp_fcn += matches[1];
-                        temp_fcn += matches[3];
-                        temp_fcn += "(";
-                        string temp_args = matches[4];
-                        while (std::regex_match(temp_args, matches, reg_args)) {
-                            temp_args = trim(matches[1]);
-                            temp_args += ", ";
-                            temp_args += trim(matches[3]);
-                        }
-                        if (std::regex_match(temp_args, matches, reg_args_end)) {
-                            temp_args = trim(matches[1]);
-                        }
-                        temp_fcn += temp_args;
-                        temp_fcn += ");\n";
-                        add_functions += temp_fcn;
-                        added_functions = true;
-                    }
-                    else if (std::regex_match(read_line, matches, reg_template)) {
-                        template_fcn = "template <" + string(matches[2]) + ">\n";
-                    }
-                    else {
-                        template_fcn = "";
-                    }
-                    if (read_line_loop) {
-                        read_line = read_line_next;
-                        read_line_loop = false;
-                        goto forward_declare;
-                    }
-                }
-            }
-            // If a file doesn't add any new structs/functions, remove it from *_zmake.cpp.
-            if (added_structs) forward_structs.emplace_back(add_structs);
-            if (added_functions) forward_functions.emplace_back(add_functions);
-
-            qt.close();
-            in_string = false;
-            in_comment = false;
-            read_line_loop = false;
-        }
-        bool empty_start_lines = true;
-
-        // Add rest of code to *_zmake.cpp
-        std::vector<string> forward_zcode;
-        forward_zcode.reserve(16);
-        string zfile_code = "";
-
-        for (unsigned int i = 0; i < zfiles.size(); i++) {
-            qt.open(zfiles.at(i));
-            if (!qt.is_open()) {
-                print("- Couldn't open file \"", zfiles.at(i), "\", aborting.\n");
-                return EXIT_FAILURE;
-            }
-            zfile_code = string("\n// From ") + zfiles.at(i).u8string() + string("\n");
-            empty_start_lines = true;
-            // Just dont add includes
-            while (getline(qt, read_line)) {
-                if (in_string) {
-                    if (std::regex_match(read_line, matches, reg_string_end)) {
-                        in_string = false;
-                    }
-                }
-                else if (in_comment) {
-                    if (std::regex_match(read_line, matches, reg_comment_end)) {
-                        in_comment = false;
-                    }
-                }
-                else {
-                    if (std::regex_match(read_line, matches, reg_string_start) && !in_comment) {
-                        in_string = true;
-                    }
-                    else if (std::regex_match(read_line, matches, reg_comment_start) && !in_string) {
-                        in_comment = true;
-                    }
-                    else if (std::regex_match(read_line, matches, reg_include)) {
-                        continue;
-                    }
-                }
-                if (empty_start_lines && streq(read_line, "")) continue;
-                else empty_start_lines = false;
-                zfile_code += read_line;
-                zfile_code += "\n";
-            }
-            forward_zcode.emplace_back(zfile_code);
-            qt.close();
-            in_string = false;
-            in_comment = false;
-        }
-
-        // Fix main.cpp
-        string main_cpp = "//// This file was automatically generated by\n//// "
-                             + ZMAKE_VERSION + ", at " + timestr() + ".\n";
-        if (include_list.size() != 0) main_cpp += "\n//// Includes\n";
-        for (unsigned int i = 0; i < include_list.size(); i++) {
-            main_cpp += include_list.at(i).at(0);
-            // Add soft tabs
-            int tabsize = static_cast<int>(include_list.at(i).at(0).length());
-            tabsize = 4 - (tabsize % 4);
-            for (int j = 0; j < tabsize; j++) main_cpp += " ";
-
-            main_cpp += "// From ";
-            for (unsigned int j = 1; j < include_list.at(i).size(); j++) {
-                if (j > 1) main_cpp += ", ";
-                main_cpp += include_list.at(i).at(j);
-            }
-            main_cpp += "\n";
-        }
-
-
-
-        if (use_unity && cppfiles.size() > 0) {
-            main_cpp += "\n//// Unity includes\n";
-            for (unsigned int i = 0; i < cppfiles.size(); i++) {
-                main_cpp += "#include \"" + cppfiles.at(i) + "\"\n";
-            }
-        }
-        if (forward_structs.size() > 0) {
-            main_cpp += "\n//// Structs, classes and unions\n";
-            for (unsigned int i = 1; i < forward_structs.size(); i++) {
-                main_cpp += forward_structs.at(i);
-                main_cpp += "\n";
-            }
-            main_cpp += forward_structs.at(0);
-        }
-        if (forward_functions.size() > 0) {
-            main_cpp += "\n//// Functions\n";
-            for (unsigned int i = 1; i < forward_functions.size(); i++) {
-                main_cpp += forward_functions.at(i);
-                main_cpp += "\n";
-            }
-            main_cpp += forward_functions.at(0);
-        }
-        if (forward_zcode.size() > 0) {
-            main_cpp += "\n//// Code";
-            for (unsigned int i = 1; i < forward_zcode.size(); i++) {
-                main_cpp += forward_zcode.at(i);
-            }
-            main_cpp += forward_zcode.at(0);
-        }
-
-
+        std::vector<fs::path> entries;
+        if (use_zpp) entries.emplace_back(zfiles_inclist.at(static_cast<unsigned int>(main_entry)));
+        string main_cpp = "";
+        if (!merge_zpp(entries, zfiles_inclist, use_unity ? cppfiles : std::vector<string>(), { "include", "src" }, use_global_modules, main_cpp)) return EXIT_FAILURE;
 
         // Add it to cppfiles (program_name looks like "boo" with quotations)
         string open_filename = program_name.substr(1, program_name.length() - 2) + "_zmake.cpp";
         if (!build_manual_files) open_filename = "build" + FOLDER_NOTATION + open_filename;
-        if (use_unity || use_zpp) {
+        if ((use_unity || use_zpp) && targets.size() == 0) {
             pt.open(open_filename, std::ios::trunc);
             pt << main_cpp;
             pt.close();
@@ -1325,19 +4738,95 @@ R"(
             else temp_str = "-I" + temp_str;
             commands.insert(commands.begin(), temp_str);
         }
-        // Put them into the commands
-        if (!use_unity) {
-            for (unsigned int i = 0; i < cppfiles.size(); i++) {
-                commands.insert(commands.begin(), cppfiles.at(i));
-            }
+        // Library headers, a zmake project keeps them in /include
+        for (const Library& library: libraries) {
+            fs::path include = library.path / "include";
+            if (!fs::exists(library.path / "zmake.cfg") || !fs::exists(include)) include = library_sources(library);
+            commands.insert(commands.begin(), "-I\"" + fs::absolute(include).u8string() + "\"");
         }
-        else commands.insert(commands.begin(), "\"" + open_filename + "\"");
+        // Put them after the compiler once the flags are done, targets add their own files
+        string source_files = "";
+        std::vector<string> tu_files;
+        if (targets.size() > 0) {}
+        else if (!use_unity) tu_files = cppfiles;
+        else tu_files = { "\"" + open_filename + "\"" };
+        for (const string& file: tu_files) source_files += " " + file;
 
         // Fix cversion and compiler flags
         if (ends_with(compiler, "cl")) cversion = "-std:" + cversion;
         else cversion = "-std=" + cversion;
         commands.insert(commands.begin(), cversion);
 
+        // Link-time optimization, the same flags go to both compiling and linking.
+        // ThinLTO keeps a cache in build/lto_cache so release builds stay incremental.
+        if (streq(lto, "thin", "full")) {
+            string jobs = std::to_string(lto_jobs);
+            string cache = fs::absolute("build" + FOLDER_NOTATION + "lto_cache").u8string();
+            if (streq(compiler, "cl")) {
+                commands.emplace_back("-GL");
+                libpath_cl += " -LTCG";
+            }
+            else if (streq(compiler, "clang-cl")) {
+                commands.emplace_back("-flto=" + lto);
+                linker = "lld";
+                libpath_cl += " -opt:lldltojobs=" + jobs;
+                if (streq(lto, "thin")) libpath_cl += " -lldltocache:\"" + cache + "\"";
+            }
+            else if (is_clang(compiler)) {
+                commands.emplace_back("-flto=" + lto);
+                #ifdef __APPLE__
+                if (streq(lto, "thin")) commands.emplace_back("-Wl,-cache_path_lto,\"" + cache + "\"");
+                #else
+                // The system linker can't do LTO with clang objects, so take lld unless another one is set
+                if (streq(linker, "", "default")) linker = "lld";
+                if (streq(linker, "lld")) {
+                    commands.emplace_back("-Wl,--thinlto-jobs=" + jobs);
+                    if (streq(lto, "thin")) commands.emplace_back("-Wl,--thinlto-cache-dir=\"" + cache + "\"");
+                }
+                else {
+                    commands.emplace_back("-Wl,-plugin-opt,jobs=" + jobs);
+                    if (streq(lto, "thin")) commands.emplace_back("-Wl,-plugin-opt,cache-dir=\"" + cache + "\"");
+                }
+                #endif
+            }
+            else {
+                // gcc has no ThinLTO, but its partitioned LTO runs in parallel the same way
+                commands.emplace_back("-flto=" + jobs);
+            }
+        }
+
+        // Faster linkers, cl always uses link.exe and clang-cl can only switch to lld-link
+        if (!streq(linker, "", "default")) {
+            if (streq(compiler, "cl") || (streq(compiler, "clang-cl") && !streq(linker, "lld"))) {
+                print("- Linker \"", linker, "\" isn't supported with ", compiler, ", ignoring.\n");
+                linker = "default";
+            }
+            else commands.emplace_back("-fuse-ld=" + linker);
+        }
+
+        // Split DWARF keeps the debug info out of the link, the .dwo files go in build/<profile>.
+        // With a fast linker we also get a .gdb_index, so the debugger starts faster.
+        if (use_split_dwarf) {
+            if (ends_with(compiler, "cl") || ON_WINDOWS) {
+                print("- Split DWARF isn't supported with ", compiler, ", ignoring.\n");
+            }
+            else {
+                bool has_debug_flag = false;
+                for (const string& command: commands) if (streq(command.substr(0, 2), "-g")) has_debug_flag = true;
+                if (!has_debug_flag) commands.emplace_back("-g");
+                commands.emplace_back("-gsplit-dwarf");
+                if (!build_manual_files) {
+                    fs::path dwo_dir = fs::absolute("build" + FOLDER_NOTATION + build_profile);
+                    fs::create_directories(dwo_dir);
+                    for (const auto& p: fs::directory_iterator(dwo_dir)) {
+                        if (streq(p.path().extension().u8string(), ".dwo")) fs::remove(p.path());
+                    }
+                    commands.emplace_back("-dumpdir \"" + dwo_dir.u8string() + FOLDER_NOTATION + "\"");
+                }
+                if (!streq(linker, "", "default")) commands.emplace_back("-Wl,--gdb-index");
+            }
+        }
+
         if (!has_output_flag) commands.emplace_back("-o");
         string compilation_string = compiler;
 
@@ -1382,8 +4871,163 @@ R"(
 
         if (ON_WINDOWS && !ends_with(build_name, ".exe\"")) build_name = build_name.substr(0, build_name.length()-1) + ".exe\"";
 
-        compilation_string += " " + build_name;
-        if (!streq(libpath_cl, "")) compilation_string += " -link" + libpath_cl;
+        string link_string = "";
+        if (!streq(libpath_cl, "")) link_string = " -link" + libpath_cl;
+        #ifdef __linux__
+        if ((use_profile && profile.sampler) || use_allocstats) link_string += " -ldl";   // dladdr(), part of libc since glibc 2.34
+        #endif
+        if (use_allocstats) link_string += " -rdynamic";    // So dladdr() can name the program's functions
+
+        // -stats also reports how much memory the compiler needed, to size build machines
+        report_memory = use_stats;
+        if (max_memory_kb > 0 && use_cmd) print("- Keeping compile jobs under ", max_memory_kb / 1024, " MB.\n");
+
+        // Workers take object jobs from here on
+        bool use_workers = workers.size() > 0 && connect_workers() > 0;
+
+        // Libraries are built first, and only when they've changed
+        string library_files = "";
+        auto l = std::chrono::steady_clock::now();
+        if (!build_libraries(libraries, compiler, compilation_string, build_profile, jobs_num, use_cmd, use_global_modules, library_files)) {
+            print("- Compiling libraries failed, aborting.\n");
+            return EXIT_FAILURE;
+        }
+        std::chrono::duration<double, std::milli> fp_libraries = std::chrono::steady_clock::now() - l;
+        link_string = library_files + link_string;
+
+        // With workers every file is compiled into build/<profile>/obj as its own job, so they can be
+        // spread out, and only linked here. PGO and output flags need the usual single command.
+        std::chrono::duration<double, std::milli> fp_objects(0);
+        if (use_workers && targets.size() == 0 && !use_pgo && !has_output_flag && !ends_with(compiler, "cl")) {
+            auto o = std::chrono::steady_clock::now();
+            fs::path obj_dir = "build" + FOLDER_NOTATION + build_profile + FOLDER_NOTATION + "obj";
+            fs::create_directories(obj_dir);
+            std::vector<Job> jobs;
+            source_files = "";
+            for (const string& file: tu_files) {
+                fs::path source = file.substr(1, file.length() - 2);
+                fs::path object = obj_dir / (source.stem().u8string() + "_" + to_hex(fnv1a(file)).substr(0, 8) + ".o");
+                source_files += " \"" + object.u8string() + "\"";
+                jobs.emplace_back(object_job(source.filename().u8string(), compilation_string, source, object));
+            }
+            if (use_cmd) print("- Compiling ", jobs.size(), " files with ", jobs_num, " jobs and ", workers.size(), " workers:\n");
+            bool success = run_jobs(jobs, jobs_num, use_cmd);
+            if (use_cmd) print("\n");
+            if (!success) {
+                print("- Compilation failed, aborting.\n");
+                return EXIT_FAILURE;
+            }
+            fp_objects = std::chrono::steady_clock::now() - o;
+        }
+        compilation_string = compiler + source_files + compilation_string.substr(compiler.length());
+
+        // Multiple targets share the C/C++ files, so those are compiled once into build/<profile>/obj
+        // (as one unity file unless -nounity), and every target merges its own .zpp files and links
+        // against the objects. The targets are built in parallel.
+        if (targets.size() > 0) {
+            string name = program_name.substr(1, program_name.find_last_of('_') - 1);
+            fs::path obj_dir = "build" + FOLDER_NOTATION + build_profile + FOLDER_NOTATION + "obj";
+            fs::create_directories(obj_dir);
+            std::vector<Job> jobs;
+            string objects = "";
+
+            std::vector<string> shared_files = cppfiles;
+            if (use_unity && cppfiles.size() > 0) {
+                string shared_cpp = "build" + FOLDER_NOTATION + name + "_shared_zmake.cpp";
+                pt.open(shared_cpp, std::ios::trunc);
+                pt << "//// This file was automatically generated by\n//// " << ZMAKE_VERSION << ", at " << timestr() << ".\n";
+                pt << "\n//// Unity includes\n";
+                for (const string& file: cppfiles) pt << "#include " << file << "\n";
+                pt.close();
+                shared_files = { "\"" + shared_cpp + "\"" };
+            }
+            for (const string& file: shared_files) {
+                fs::path source = file.substr(1, file.length() - 2);
+                fs::path object = obj_dir / (source.stem().u8string() + "_" + to_hex(fnv1a(file)).substr(0, 8) +
+                                             (ends_with(compiler, "cl") ? ".obj" : ".o"));
+                objects += " \"" + object.u8string() + "\"";
+                jobs.emplace_back(object_job(source.filename().u8string(), compilation_string, source, object));
+            }
+            std::size_t shared_jobs = jobs.size();
+
+            std::vector<fs::path> outputs;
+            std::vector<Target> built;
+            for (const Target& target: targets) {
+                if (target.test != use_test) continue;
+                if (!streq(selected_target, "") && !streq(selected_target, target.name)) continue;
+                // Tests go in build/tests, so they can't clash with the program's targets
+                fs::path dir = target.test ? "build" + FOLDER_NOTATION + "tests" : "build";
+                fs::create_directories(dir);
+                fs::path source = target.entry;
+                if (streq(target.entry.extension().u8string(), ".z", ".zpp")) {
+                    string target_cpp = "";
+                    if (!merge_zpp({ target.entry }, zfiles_inclist, {}, { "include", "src" }, use_global_modules, target_cpp)) return EXIT_FAILURE;
+                    source = dir / (target.name + "_zmake.cpp");
+                    pt.open(source, std::ios::trunc);
+                    pt << target_cpp;
+                    pt.close();
+                }
+                fs::path output = dir / (target.name + "_" + build_profile + (ON_WINDOWS ? ".exe" : ""));
+                outputs.emplace_back(output);
+                built.emplace_back(target);
+                string flags = streq(target.flags, "") ? "" : " " + target.flags;
+                Job job { target.name, compiler + flags + " \"" + source.u8string() + "\"" + objects + compilation_string.substr(compiler.length()) +
+                          " \"" + output.u8string() + "\"" + link_string, {}, -1 };
+                for (std::size_t i = 0; i < shared_jobs; i++) job.deps.emplace_back(i);
+                jobs.emplace_back(job);
+            }
+
+            if (use_cmd) print("- Compiling ", outputs.size(), use_test ? " tests" : " targets", " and ", shared_jobs, " shared files with ", jobs_num, " jobs:\n");
+            auto b = std::chrono::steady_clock::now();
+            bool success = run_jobs(jobs, jobs_num, use_cmd);
+            auto c = std::chrono::steady_clock::now();
+            if (use_cmd) print("\n");
+            std::chrono::duration<double, std::milli> fp_zmake = b - a - fp_libraries;
+            std::chrono::duration<double, std::milli> fp_compiler = c - b;
+            if (use_time) {
+                print("- zmake took ", fp_zmake.count(), " ms, ");
+                if (libraries.size() > 0) print("libraries took ", fp_libraries.count(), " ms, ");
+                print(compiler, " took ", fp_compiler.count(), " ms.\n");
+            }
+            if (!success) {
+                print("- Compilation failed, aborting.\n");
+                return EXIT_FAILURE;
+            }
+
+            if (use_test) return use_run ? run_tests(built, outputs, run_args, test, jobs_num) : EXIT_SUCCESS;
+            if (!use_run && !use_bench && !use_profile) return EXIT_SUCCESS;
+            if (outputs.size() != 1) {
+                print("- Built ", outputs.size(), " targets, choose one to run with \"-target=name\".\n");
+                return EXIT_SUCCESS;
+            }
+            if (use_bench) {
+                string target_name = outputs.at(0).stem().u8string();
+                target_name = target_name.substr(0, target_name.length() - build_profile.length() - 1);
+                bench.results = "build" + FOLDER_NOTATION + target_name + "_bench.json";
+                // Next to the sources rather than in build, so it's committed and survives "zmake clean"
+                if (streq(bench.baseline.u8string(), "")) bench.baseline = "bench" + FOLDER_NOTATION + target_name + "_baseline.json";
+                return run_bench(outputs.at(0), run_args, bench);
+            }
+            if (use_profile) return run_profile(outputs.at(0), run_args, profile);
+            print("- Opening \"", outputs.at(0).filename().u8string(), "\":\n");
+            return open_program(outputs.at(0), run_args, use_stats);
+        }
+
+        // Train with an instrumented build first, then use the profile in the real one
+        std::chrono::duration<double, std::milli> fp_pgo(0);
+        if (use_pgo) {
+            auto p = std::chrono::steady_clock::now();
+            // Headers and library sources change the program as much as /src does
+            std::vector<fs::path> source_dirs = { "src", "include" };
+            for (const Library& library: libraries) source_dirs.emplace_back(library.path);
+            string use_flag = pgo_train(compiler, compilation_string, link_string, build_name.substr(1, build_name.length() - 2),
+                                        source_dirs, pgo, use_cmd);
+            if (streq(use_flag, "")) return EXIT_FAILURE;
+            compilation_string = compiler + " " + use_flag + compilation_string.substr(compiler.length());
+            fp_pgo = std::chrono::steady_clock::now() - p;
+        }
+
+        compilation_string += " " + build_name + link_string;
 
         if (use_cmd) {
             print("- Compiling ", program_name, " with the following:\n", compilation_string, "\n\n");
@@ -1391,34 +5035,49 @@ R"(
 
         // Compile
         auto b = std::chrono::steady_clock::now();
-        system(compilation_string.c_str());
+        jobserver_acquire();
+        RunStats compile_stats;
+        int compile_status = run_command(compilation_string, compile_stats);
+        jobserver_release();
         auto c = std::chrono::steady_clock::now();
-        auto filetime_est = std::time(nullptr);
 
-        std::chrono::duration<double, std::milli> fp_zmake = b - a;
+        std::chrono::duration<double, std::milli> fp_zmake = b - a - fp_libraries - fp_pgo - fp_objects;
         std::chrono::duration<double, std::milli> fp_compiler = c - b;
 
         if (use_time) {
-            print("- zmake took ", fp_zmake.count(), " ms, ", compiler, " took ", fp_compiler.count(), " ms.\n");
+            print("- zmake took ", fp_zmake.count(), " ms, ");
+            if (libraries.size() > 0) print("libraries took ", fp_libraries.count(), " ms, ");
+            if (fp_objects.count() > 0.0) print("objects took ", fp_objects.count(), " ms, ");
+            if (use_pgo) print("PGO training took ", fp_pgo.count(), " ms, ");
+            print(compiler, " took ", fp_compiler.count(), " ms.\n");
+        }
+        if (report_memory && compile_stats.max_rss_kb > 0) {
+            print("- ", compiler, " peaked at ", static_cast<double>(compile_stats.max_rss_kb) / 1024.0, " MB.\n");
         }
 
-        // Open the program
-        if (use_run) {
-            for (const auto& p: fs::recursive_directory_iterator("build")) {
-                if (fs::is_directory(p.path())) continue;
-                if (!streq(p.path().extension().u8string(), "", ".exe")) continue;
-                if (!streq(program_name, "\"" + p.path().stem().string() + "\"")) continue;
+        if (compile_status != 0) {
+            print("- Compilation failed, aborting.\n");
+            return EXIT_FAILURE;
+        }
 
-                auto filetime = file_to_t(p.path().string());
+        if (use_profile) return run_profile(build_name.substr(1, build_name.length() - 2), run_args, profile);
 
-                if (abs(filetime - filetime_est) > 1) continue;
+        if (use_bench) {
+            string name = program_name.substr(1, program_name.find_last_of('_') - 1);
+            bench.results = "build" + FOLDER_NOTATION + name + "_bench.json";
+            if (streq(bench.baseline.u8string(), "")) bench.baseline = "bench" + FOLDER_NOTATION + name + "_baseline.json";
+            return run_bench(build_name.substr(1, build_name.length() - 2), run_args, bench);
+        }
 
-                print("- Opening ", program_name, ":\n");
-                system(build_name.c_str());
-                return EXIT_SUCCESS;
+        // Open the program, we know exactly where it is (build_name looks like "build/boo_dev" with quotations)
+        if (use_run) {
+            fs::path program = build_name.substr(1, build_name.length() - 2);
+            if (!fs::exists(program)) {
+                print("- Couldn't find ", build_name, ", aborting.\n");
+                return EXIT_FAILURE;
             }
-
-            return EXIT_FAILURE;
+            print("- Opening ", program_name, ":\n");
+            return open_program(program, run_args, use_stats);
         }
         else return EXIT_SUCCESS;
     }
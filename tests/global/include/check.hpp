@@ -0,0 +1,28 @@
+#pragma once
+#include <cstdio>
+#include <cstdlib>
+
+// For the tests in tests/: CHECK(condition) reports a condition that doesn't hold with its line in the
+// merged file (build/tests/NAME_zmake.cpp) on stderr, which "zmake test" shows when the test fails,
+// and returns whether it held. main() returns check_status(), EXIT_FAILURE if any check failed.
+
+#define CHECK(...) check_passed(static_cast<bool>(__VA_ARGS__), __FILE__, __LINE__, #__VA_ARGS__)
+
+inline int checks_failed = 0;
+
+inline bool check_passed(bool passed, const char* file, int line, const char* condition) {
+    if (passed) return true;
+    checks_failed++;
+    std::fprintf(stderr, "%s:%d: CHECK(%s) failed\n", file, line, condition);
+    return false;
+}
+
+inline int check_status() {
+    return checks_failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+// For a test that can't run on this machine: return skip_test("why"), which "zmake test" shows as SKIP with the reason
+inline int skip_test(const char* reason) {
+    std::fprintf(stderr, "Skipped: %s\n", reason);
+    return 77;
+}
@@ -0,0 +1,5 @@
+#pragma once
+#include <string>
+
+// Compiled once in src/checksum.cpp and linked into both targets
+unsigned int checksum(const std::string& str);
@@ -0,0 +1,7 @@
+#include "checksum.hpp"
+
+unsigned int checksum(const std::string& str) {
+    unsigned int sum = 0;
+    for (char c: str) sum = sum * 31 + static_cast<unsigned char>(c);
+    return sum;
+}
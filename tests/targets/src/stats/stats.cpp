@@ -0,0 +1,7 @@
+#include "stats.hpp"
+
+double mean(const std::vector<double>& values) {
+    double sum = 0.0;
+    for (double value: values) sum += value;
+    return values.empty() ? 0.0 : sum / static_cast<double>(values.size());
+}
@@ -0,0 +1,5 @@
+#pragma once
+#include <vector>
+
+// Built as the library "stats", see [library.stats] in zmake.cfg
+double mean(const std::vector<double>& values);